@@ -1,237 +1,236 @@
 #include "admixture.h"
 #include "../graph.h"
+#include "format.h"
+#include "outputFile.h"
+#include "scan.h"
 
+#include <charconv>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
-#include <fstream>
-#include <iomanip>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
-enum class TokenType {
-    ID,
-    SOURCE,
-    TARGET,
-    TYPE,
-    NUM
-};
+// id source target type weight proportion proportion, where the weight
+// can be printed with a space after its exponent sign, like 3.22e- 2.
+const size_t ID_FIELD = 0;
+const size_t SOURCE_FIELD = 1;
+const size_t TARGET_FIELD = 2;
+const size_t TYPE_FIELD = 3;
+const size_t WEIGHT_FIELD = 4;
+const size_t NUM_PROPORTIONS = 2;
+const size_t MAX_FIELDS = 8;
+
+static bool isNumber(std::string_view s) {
+    return !s.empty() && s.find_first_not_of("0123456789") == std::string_view::npos;
+}
 
-struct Token {
-public:
-    Token(TokenType type, const std::string &value) : type(type), value(value) {}
+static bool containsNumber(std::string_view s) {
+    return !s.empty() && s.find_first_of("0123456789-") != std::string_view::npos;
+}
 
-public:
-    TokenType type;
-    std::string value;
-};
+// NaN for NA and anything else that isn't a number.
+static float toFloat(const std::string_view *fields, size_t count) {
+    char buf[64];
+    size_t len = 0;
 
-static bool isNumber(const std::string &s) {
-    return !s.empty() && s.find_first_not_of("0123456789") == std::string::npos;
-}
+    for (size_t i = 0; i < count; i++) {
+        if (len + fields[i].size() > sizeof(buf)) {
+            return NAN;
+        }
+
+        std::memcpy(buf + len, fields[i].data(), fields[i].size());
+        len += fields[i].size();
+    }
+
+    float res;
+    auto [end, err] = std::from_chars(buf, buf + len, res);
 
-static bool containsNumber(const std::string &s) {
-    return !s.empty() && s.find_first_of("0123456789-") != std::string::npos;
+    return err == std::errc() && end == buf + len ? res : NAN;
 }
 
-static std::vector<Token> tokenize(std::ifstream &f) {
-    std::vector<Token> tokens;
+// The shortest text that reads back as the same float.
+static std::string formatFloat(float x) {
+    char buf[32];
 
-    std::string line;
+    return std::string(buf, std::to_chars(buf, buf + sizeof(buf), x).ptr);
+}
 
-    while (std::getline(f, line)) {
-        std::istringstream ss(line);
-        std::string word;
-        std::vector<std::string> words;
+// Builds the graph as the lines are read, naming nodes after their ids.
+struct Builder {
+public:
+    NodeIndex getIndex(Graph &g, std::string_view id) {
+        auto [it, inserted] = index.try_emplace(id, names.size());
 
-        while (ss >> word) {
-            words.push_back(word);
+        if (inserted) {
+            names.push_back(id);
+            g.addNode();
         }
 
-        for (size_t i = 0; i < words.size(); i++) {
-            if (i >= static_cast<size_t>(TokenType::NUM)) {
-                continue;
-            }
+        return it->second;
+    }
 
-            TokenType type = static_cast<TokenType>(i);
+    void addEdge(Graph &g, NodeIndex source, NodeIndex target, float weight, float proportion) {
+        edges.push_back({source, g.adjList[source].size(), weight, proportion});
+        g.addEdge(source, target);
+    }
 
-            if (type == TokenType::ID) {
-                if (!isNumber(words[i])) {
-                    return std::vector<Token>();
-                }
+    // Puts the weights in the order freeze() lays out the edges.
+    void finish(Graph &g) {
+        std::vector<NodeIndex> offsets(g.adjList.size() + 1, 0);
 
-            } else if (type == TokenType::TYPE) {
-                if (containsNumber(words[i])) {
-                    return std::vector<Token>();
-                }
-            }
+        for (size_t n = 0; n < g.adjList.size(); n++) {
+            offsets[n + 1] = offsets[n] + g.adjList[n].size();
+        }
 
-            if (type == TokenType::SOURCE || type == TokenType::TARGET) {
-                tokens.emplace_back(type, words[i]);
-            } else if (type == TokenType::ID || type == TokenType::TYPE) {
-                tokens.emplace_back(type, words[i]);
+        g.edgeWeights.assign(edges.size(), NAN);
+        g.admixProportions.assign(edges.size(), NAN);
+
+        for (const Edge &e : edges) {
+            g.edgeWeights[offsets[e.source] + e.slot] = e.weight;
+            g.admixProportions[offsets[e.source] + e.slot] = e.proportion;
+        }
+
+        for (size_t n = 0; n < g.adjList.size(); n++) {
+            if (g.adjList[n].empty()) {
+                g.leaves.push_back(n);
+                g.leafName[n] = std::string(names[n]);
             }
         }
     }
 
-    return tokens;
-}
+private:
+    struct Edge {
+        NodeIndex source;
+        // Where the target is in the source's children.
+        size_t slot;
+        float weight;
+        float proportion;
+    };
+
+    // Views into the file, which outlives the parse.
+    std::unordered_map<std::string_view, NodeIndex> index;
+    std::vector<std::string_view> names;
+    std::vector<Edge> edges;
+};
+
+bool isADMIX(std::string_view data) {
+    std::string_view head = sniffHead(data);
+    std::string_view line;
+    std::string_view fields[MAX_FIELDS];
 
-static bool parse(Graph &g, const std::vector<Token> &tokens) {
-    if (tokens.empty()) {
+    if (!nextLine(head, line) || splitFields(line, fields, MAX_FIELDS) <= TYPE_FIELD) {
         return false;
     }
 
-    std::unordered_map<std::string, uint64_t> idToIndex;
-    std::unordered_map<uint64_t, std::string> indexToId;
+    return isNumber(fields[ID_FIELD]) && !containsNumber(fields[TYPE_FIELD]);
+}
 
-    TokenType nextExpectedType = TokenType::ID;
+bool openADMIX(Graph &g, std::string_view data) {
+    Builder b;
+    std::string_view line;
+    std::string_view fields[MAX_FIELDS];
+    bool anyEdges = false;
 
-    for (size_t i = 0; i < tokens.size(); i++) {
-        if (tokens[i].type != nextExpectedType) {
-            return false;
+    while (nextLine(data, line)) {
+        size_t numFields = splitFields(line, fields, MAX_FIELDS);
+
+        if (numFields == 0) {
+            continue;
         }
 
-        switch (tokens[i].type) {
-            case TokenType::ID:
-                nextExpectedType = TokenType::SOURCE;
-                break;
-            case TokenType::SOURCE:
-                {
-                    auto it = idToIndex.find(tokens[i].value);
-
-                    if (it == idToIndex.end()) {
-                        indexToId[idToIndex.size()] = tokens[i].value;
-                        idToIndex[tokens[i].value] = idToIndex.size();
-
-                        g.addNode();
-                    }
-
-                }
-
-                nextExpectedType = TokenType::TARGET;
-                break;
-            case TokenType::TARGET:
-                {
-                    auto it = idToIndex.find(tokens[i].value);
-
-                    uint64_t source = idToIndex.at(tokens[i - 1].value);
-                    uint64_t target;
-
-                    if (it == idToIndex.end()) {
-                        target = idToIndex.size();
-                        indexToId[target] = tokens[i].value;
-                        idToIndex[tokens[i].value] = target;
-
-                        g.addNode();
-                    } else {
-                        target = it->second;
-                    }
-
-                    g.addEdge(source, target);
-                }
-
-                nextExpectedType = TokenType::TYPE;
-                break;
-            case TokenType::TYPE:
-                {
-                    if (tokens[i].value == "admix") {
-                        uint64_t reticulation = idToIndex.at(tokens[i - 1].value);
-                        uint64_t parent = idToIndex.at(tokens[i - 2].value);
-
-                        g.reticulations[reticulation].push_back(parent);
-                    }
-                }
-
-                nextExpectedType = TokenType::ID;
-                break;
-            default:
-                break;
+        if (numFields <= TYPE_FIELD
+        ||  !isNumber(fields[ID_FIELD])
+        ||  containsNumber(fields[TYPE_FIELD])) {
+            return false;
         }
-    }
 
-    for (size_t i = 0; i < g.adjList.size(); i++) {
-        if (g.adjList[i].empty()) {
-            g.leaves.push_back(i);
-            g.leafName[i] = indexToId[i];
+        // Whatever is left after the weight are the two proportions.
+        float weight = NAN;
+        float proportion = NAN;
+
+        if (numFields >= WEIGHT_FIELD + 1 + NUM_PROPORTIONS) {
+            weight = toFloat(fields + WEIGHT_FIELD, numFields - NUM_PROPORTIONS - WEIGHT_FIELD);
+            proportion = toFloat(fields + numFields - NUM_PROPORTIONS, 1);
+        } else if (numFields > WEIGHT_FIELD) {
+            weight = toFloat(fields + WEIGHT_FIELD, numFields - WEIGHT_FIELD);
         }
-    }
 
-    return true;
-}
+        NodeIndex source = b.getIndex(g, fields[SOURCE_FIELD]);
+        NodeIndex target = b.getIndex(g, fields[TARGET_FIELD]);
 
-bool openADMIX(Graph &g, const std::string &file) {
-    std::ifstream f(file);
+        b.addEdge(g, source, target, weight, proportion);
 
-    if (!f.is_open()) {
+        if (fields[TYPE_FIELD] == "admix") {
+            g.reticulations[target].push_back(source);
+        }
+
+        anyEdges = true;
+    }
+
+    if (!anyEdges) {
         return false;
     }
 
-    std::vector<Token> tokens = tokenize(f);
-    f.close();
+    b.finish(g);
 
-    return parse(g, tokens);
+    return true;
 }
 
 void saveADMIX(const Graph &g, const std::string &filename) {
-    std::ofstream f(filename);
+    OutputFile f;
 
-    if (!f) {
+    if (!f.open(filename)) {
         std::cerr << "Failed to save to '" << filename << "'."<< std::endl;
         std::exit(EXIT_FAILURE);
     }
 
-    uint64_t edgeCount = 1;
+    NodeIndex edgeCount = 1;
 
-    f << std::left;
+    for (size_t s = 0; s < g.getNumNodes(); s++) {
+        for (const NodeIndex &t : g.children(s)) {
+            // Edges go by in childTargets order.
+            NodeIndex edge = edgeCount - 1;
 
-    for (size_t s = 0; s < g.adjList.size(); s++) {
-        for (size_t t = 0; t < g.adjList[s].size(); t++) {
-            f << std::setw(4) << std::to_string(edgeCount);
+            f.padded(std::to_string(edgeCount), 4);
             edgeCount++;
 
-            f << std::setw(7) << "n" + std::to_string(s);
-
-            auto leafIt = g.leafName.find(g.adjList[s][t]);
+            f.padded("n" + std::to_string(s), 7);
 
-            f << std::setw(7);
-            if (leafIt != g.leafName.end()) {
-                f << leafIt->second;
+            if (g.isLeaf(t)) {
+                f.padded(g.getLeafName(t), 7);
             } else {
-                f << "n" + std::to_string(g.adjList[s][t]);
+                f.padded("n" + std::to_string(t), 7);
             }
 
-            auto reticIt = g.reticulations.find(g.adjList[s][t]);
+            bool isReticulation = g.isReticulation(t);
 
-            f << std::setw(7);
-            if (reticIt != g.reticulations.end()) {
-                f << "admix";
-            } else {
-                f << "edge";
-            }
+            f.padded(isReticulation ? "admix" : "edge", 7);
 
-            f << std::setw(8);
-            f << "0";
+            float weight = g.edgeWeights.empty() ? NAN : g.edgeWeights[edge];
+            float proportion = g.admixProportions.empty() ? NAN : g.admixProportions[edge];
 
-            f << std::setw(8);
-            if (reticIt != g.reticulations.end()) {
-                f << "0.5";
-            } else {
-                f << "NA";
-            }
+            // Long weights like -1.58e-19 would run into the next column.
+            f.padded(std::isnan(weight) ? "0" : formatFloat(weight), 7);
+            f << ' ';
 
-            if (reticIt != g.reticulations.end()) {
-                f << "0.5";
-            } else {
-                f << "NA";
+            std::string proportionText = "NA";
+            if (isReticulation) {
+                proportionText = std::isnan(proportion) ? "0.5" : formatFloat(proportion);
             }
 
-            f << std::endl;
+            f.padded(proportionText, 8);
+            f << proportionText << '\n';
         }
     }
 
-    f.close();
+    if (!f.close()) {
+        std::cerr << "Failed to save to '" << filename << "'."<< std::endl;
+        std::exit(EXIT_FAILURE);
+    }
 }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 #include "../graph.h"
 
-bool openADMIX(Graph &g, const std::string &file);
+bool isADMIX(std::string_view data);
+bool openADMIX(Graph &g, std::string_view data);
 void saveADMIX(const Graph &g, const std::string &filename);
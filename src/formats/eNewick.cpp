@@ -1,245 +1,259 @@
 #include "eNewick.h"
 #include "../graph.h"
 
+#include <cctype>
 #include <cstdint>
-#include <cstdio>
 #include <cstdlib>
-#include <fstream>
-#include <functional>
 #include <iostream>
-#include <stack>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
-enum class TokenType {
-    OPEN_PARENTHESIS,
-    CLOSE_PARENTHESIS,
-    COMMA,
-    SEMI_COLON,
-    LENGTH,
-    INTERNAL_NAME,
-    LEAF_NAME,
-    HYBRID_ID,
-};
-
-struct Token {
-    TokenType type;
-    std::string value;
-};
+#include "format.h"
+#include "outputFile.h"
+#include "scan.h"
+#include "treemix.h"
+
+static const ByteClass NAME_CHARS("", true, true);
+// Names, the start of a branch length and everything a parser acts on.
+static const ByteClass TOKEN_STARTS("(),;#:", true, true);
+
+// Walks the mapped file once, building the graph as it goes.
+// Names are views into the file, only leaf names get copied out.
+struct Parser {
+public:
+    bool atEnd() const { return pos == end; }
+    char peek() const { return *pos; }
+
+    // Skips everything that isn't a name or one of ( ) , ; #
+    // Branch lengths are read but dropped.
+    void skip() {
+        while (true) {
+            pos = findFirst(TOKEN_STARTS, pos, end);
+
+            if (pos == end || *pos != ':') {
+                return;
+            }
 
-static std::vector<Token> tokenize(std::ifstream &f) {
-    std::vector<Token> tokens;
-    char c;
+            pos++;
 
-    while (f.get(c)) {
-        if (c == ':') {
-            f.get(c);
-            // std::string length = {c};
+            if (pos != end) {
+                pos++;
+            }
 
-            int n = f.peek();
-            while (n != EOF && (isdigit(n) || n == '.')) {
-                f.get(c);
-                // length += c;
-                n = f.peek();
+            while (pos != end && (std::isdigit(static_cast<unsigned char>(*pos)) || *pos == '.')) {
+                pos++;
             }
+        }
+    }
 
-            // tokens.push_back({TokenType::LENGTH, length});
-        } else if (isalpha(c) || isdigit(c)) {
-            std::string name = {c};
+    std::string_view name() {
+        const char *start = pos;
+        pos = findFirstNot(NAME_CHARS, pos, end);
 
-            int n = f.peek();
-            while (n != EOF && (isalpha(n) || isdigit(n))) {
-                f.get(c);
-                name += c;
-                n = f.peek();
-            }
+        return {start, static_cast<size_t>(pos - start)};
+    }
 
-            TokenType t;
-            if (!tokens.empty()
-            &&  tokens.back().type == TokenType::CLOSE_PARENTHESIS) {
-                t = TokenType::INTERNAL_NAME;
-            } else {
-                t = TokenType::LEAF_NAME;
-            }
+    // Reads the `#H1` following a name, if there is one.
+    bool hybridId(std::string_view &id) {
+        skip();
 
-            tokens.push_back({t, name});
-        } else if (c == '#') {
-            std::string hybrid_id;
+        if (pos == end || *pos != '#') {
+            return false;
+        }
 
-            int n = f.peek();
-            while (n != EOF && (isalpha(n) || isdigit(n))) {
-                f.get(c);
-                hybrid_id += c;
-                n = f.peek();
-            }
+        pos++;
+        id = name();
+        return true;
+    }
 
-            if (tokens.back().type == TokenType::OPEN_PARENTHESIS
-            ||  tokens.back().type == TokenType::HYBRID_ID) {
-                tokens.push_back({TokenType::LEAF_NAME, ""});
-            }
+public:
+    const char *pos;
+    const char *end;
+};
 
-            tokens.push_back({TokenType::HYBRID_ID, hybrid_id});
-        } else if (c == '(') {
-            tokens.push_back({TokenType::OPEN_PARENTHESIS, "("});
-        } else if (c == ')') {
-            tokens.push_back({TokenType::CLOSE_PARENTHESIS, ")"});
+static NodeIndex newNode(Graph &g) {
+    g.addNode();
+    return g.adjList.size() - 1;
+}
 
-            int n = f.peek();
-            if (n != EOF && (!isalpha(n) && !isdigit(n))) {
-                tokens.push_back({TokenType::INTERNAL_NAME, ""});
-            }
-        } else if (c == ',') {
-            tokens.push_back({TokenType::COMMA, ","});
-        } else if (c == ';') {
-            tokens.push_back({TokenType::SEMI_COLON, ";"});
+static NodeIndex getHybrid(Graph &g, std::unordered_map<std::string_view, NodeIndex> &hybrids,
+                          std::string_view id) {
+    auto it = hybrids.find(id);
 
-            // For now, we break once we hit a ;
-            // Will maybe add support if the extended newick file
-            // has multiple lines in it.
-            break;
-        }
+    if (it != hybrids.end()) {
+        return it->second;
     }
 
-    return tokens;
+    NodeIndex node = newNode(g);
+    g.reticulations[node];
+    hybrids[id] = node;
+
+    return node;
 }
 
-static bool parse(Graph &g, const std::vector<Token> &tokens) {
-    if (tokens.front().type != TokenType::OPEN_PARENTHESIS
-    ||  tokens.back().type != TokenType::SEMI_COLON) {
+// A hybrid written as `(a)#H1` is the leaf a itself, not its parent.
+// Returns whether the children just closed are only a leaf that was
+// created for them.
+static bool isLeafHybrid(const Graph &g, const std::vector<NodeIndex> &children, size_t start) {
+    if (children.size() - start != 1 || g.leaves.empty()) {
         return false;
     }
 
-    uint64_t curIndex = 0;
-    std::stack<std::vector<uint64_t>> children;
-
-    bool isLeafHybrid = false;
-    std::unordered_map<std::string, uint64_t> hybrids;
+    NodeIndex child = children.back();
 
-    for (size_t i = 0; i < tokens.size(); i++) {
-        // I think it's just easier to handle the case where a
-        // hybrid is a leaf node "separately"
-        // (In HYBRID_ID instead of LEAF_NAME)
-        if (tokens[i].type == TokenType::HYBRID_ID) {
-            if (isLeafHybrid) {
-                children.pop();
-            }
+    return child + 1 == g.adjList.size()
+        && g.leaves.back() == child
+        && g.reticulations.find(child) == g.reticulations.end();
+}
 
-            auto it = hybrids.find(tokens[i].value);
-            if (it != hybrids.end()) {
-                children.top().push_back(it->second);
+static bool parse(Graph &g, Parser &p) {
+    p.skip();
 
-                if (isLeafHybrid) {
-                    g.leaves.push_back(it->second);
-                    g.leafName[it->second] = tokens[i - 3].value;
-                }
-            } else {
-                g.addNode();
-                children.top().push_back(curIndex);
+    if (p.atEnd() || p.peek() != '(') {
+        return false;
+    }
 
-                if (isLeafHybrid) {
-                    g.leaves.push_back(curIndex);
-                    g.leafName[curIndex] = tokens[i - 3].value;
-                }
+    // The children of every open parenthesis, one after the other.
+    std::vector<NodeIndex> children;
+    std::vector<size_t> starts;
 
-                g.reticulations[curIndex];
-                hybrids[tokens[i].value] = curIndex;
+    std::unordered_map<std::string_view, NodeIndex> hybrids;
+    std::string_view id;
 
-                curIndex++;
-            }
+    while (true) {
+        p.skip();
 
-            isLeafHybrid = false;
-        } else if (tokens[i].type == TokenType::LEAF_NAME) {
-            if (tokens[i - 1].type == TokenType::OPEN_PARENTHESIS
-            &&  tokens[i + 1].type == TokenType::CLOSE_PARENTHESIS
-            &&  tokens[i + 3].type == TokenType::HYBRID_ID) {
-                isLeafHybrid = true;
-                i += 2;
-                continue;
-            }
+        if (p.atEnd()) {
+            return false;
+        }
 
-            if (tokens[i + 1].type == TokenType::HYBRID_ID) {
-                continue;
-            }
+        char c = p.peek();
 
-            g.addNode();
-            children.top().push_back(curIndex);
+        if (c == '(') {
+            p.pos++;
+            starts.push_back(children.size());
+        } else if (c == ',') {
+            p.pos++;
+        } else if (c == ')') {
+            p.pos++;
 
-            g.leaves.push_back(curIndex);
-            g.leafName[curIndex] = tokens[i].value;
+            if (starts.empty()) {
+                return false;
+            }
 
-            curIndex++;
-        } else if (tokens[i].type == TokenType::INTERNAL_NAME) {
-            bool isHybrid = tokens[i + 1].type == TokenType::HYBRID_ID;
-            auto hybridIt = hybrids.find(tokens[i + 1].value);
+            size_t start = starts.back();
+            starts.pop_back();
 
-            if (isHybrid && hybridIt == hybrids.end()) {
-                g.reticulations[curIndex];
-                hybrids[tokens[i + 1].value] = curIndex;
-            }
+            // Internal names aren't kept.
+            p.name();
+            bool isHybrid = p.hybridId(id);
 
-            bool addedNode = false;
+            if (isHybrid && isLeafHybrid(g, children, start)) {
+                NodeIndex leaf = children.back();
+                std::string name = std::move(g.leafName[leaf]);
 
-            if (!children.top().empty()) {
-                uint64_t nodeIndex = curIndex;
+                g.leafName.erase(leaf);
+                g.leaves.pop_back();
+                g.adjList.pop_back();
+                children.pop_back();
 
-                if (isHybrid) {
-                    nodeIndex = hybrids.at(tokens[i + 1].value);
-                }
+                NodeIndex node = getHybrid(g, hybrids, id);
+                g.leaves.push_back(node);
+                g.leafName[node] = std::move(name);
+                children.push_back(node);
 
-                if (nodeIndex >= curIndex) {
-                    g.addNode();
-                    addedNode = true;
-                }
+                continue;
+            }
 
-                g.adjList[nodeIndex] = std::move(children.top());
-                children.pop();
+            NodeIndex node = isHybrid ? getHybrid(g, hybrids, id) : newNode(g);
+            g.adjList[node].assign(children.begin() + start, children.end());
+            children.resize(start);
 
-                for (const uint64_t &n : g.adjList[nodeIndex]) {
-                    auto it = g.reticulations.find(n);
+            p.skip();
 
-                    if (it != g.reticulations.end()) {
-                        g.reticulations[n].push_back(curIndex);
-                    }
-                }
+            if (!p.atEnd() && p.peek() == ';') {
+                p.pos++;
+                return starts.empty();
             }
 
-            if (tokens[i + 1].type == TokenType::SEMI_COLON) {
+            children.push_back(node);
+        } else if (c == ';') {
+            return false;
+        } else {
+            // A leaf, or a `#H1` pointing at a hybrid defined elsewhere.
+            std::string_view name = p.name();
+
+            if (p.hybridId(id)) {
+                children.push_back(getHybrid(g, hybrids, id));
                 continue;
             }
 
-            if (isHybrid) {
-                children.top().push_back(hybrids.at(tokens[i + 1].value));
+            NodeIndex node = newNode(g);
+            g.leaves.push_back(node);
+            g.leafName[node] = std::string(name);
+            children.push_back(node);
+        }
+    }
+}
 
-                i++;
-            } else {
-                children.top().push_back(curIndex);
-            }
+bool isENWK(std::string_view data) {
+    std::string_view head = sniffHead(data);
 
-            if (addedNode) {
-                curIndex++;
-            }
-        } else if (tokens[i].type == TokenType::OPEN_PARENTHESIS) {
-            children.emplace();
-        }
+    return !head.empty() && head[0] == '(' && !isTreemix(data);
+}
+
+bool openENWK(Graph &g, std::string_view data) {
+    return readENWK(g, data);
+}
+
+bool readENWK(Graph &g, std::string_view &data) {
+    Parser p = {data.data(), data.data() + data.size()};
+
+    if (!parse(g, p)) {
+        return false;
     }
 
+    data = std::string_view(p.pos, p.end - p.pos);
     return true;
 }
 
-bool openENWK(Graph &g, const std::string &file) {
-    std::ifstream f(file);
+bool ENWKStream::open(const std::string &file) {
+    if (!data.open(file)) {
+        return false;
+    }
+
+    filename = file;
+    pos = data.data().data();
+    end = pos + data.data().size();
 
-    if (!f.is_open()) {
+    return true;
+}
+
+bool ENWKStream::next(Graph &g) {
+    Parser p = {pos, end};
+    p.skip();
+
+    if (p.atEnd() || error) {
         return false;
     }
 
-    std::vector<Token> tokens = tokenize(f);
-    f.close();
+    count++;
+    g = {.format = FormatType::ENWK};
+    g.filename = filename + "[" + std::to_string(count) + "]";
 
-    return parse(g, tokens);
+    if (!parse(g, p)) {
+        error = true;
+        return false;
+    }
+
+    pos = p.pos;
+    g.freeze();
+
+    return true;
 }
 
 static void nextHybridName(std::string &name) {
@@ -255,14 +269,14 @@ static void nextHybridName(std::string &name) {
     name = "a" + name;
 }
 
-static std::unordered_map<uint64_t, std::string> assignHybridStr(const Graph &g) {
-    std::unordered_map<uint64_t, std::string> res;
+static std::unordered_map<NodeIndex, std::string> assignHybridStr(const Graph &g) {
+    std::unordered_map<NodeIndex, std::string> res;
 
     uint64_t hybridId = 1;
     std::string hybridName = "a";
 
-    for (const auto &r : g.reticulations) {
-        res[r.first] = hybridName + "#H" + std::to_string(hybridId);
+    for (const NodeIndex &r : g.reticulationNodes) {
+        res[r] = hybridName + "#H" + std::to_string(hybridId);
         hybridId++;
         nextHybridName(hybridName);
     }
@@ -271,66 +285,65 @@ static std::unordered_map<uint64_t, std::string> assignHybridStr(const Graph &g)
 }
 
 void saveENWK(const Graph &g, const std::string &filename) {
-    std::ofstream f(filename);
+    OutputFile f;
 
-    if (!f) {
+    if (!f.open(filename)) {
         std::cerr << "Failed to save to '" << filename << "'."<< std::endl;
         std::exit(EXIT_FAILURE);
     }
 
-    std::unordered_set<uint64_t> hybridFirstOccurrence;
-    std::unordered_map<uint64_t, std::string> hybridStr = assignHybridStr(g);
+    std::unordered_set<NodeIndex> hybridFirstOccurrence;
+    std::unordered_map<NodeIndex, std::string> hybridStr = assignHybridStr(g);
 
-    std::function<void (uint64_t)> dfs = [&](uint64_t node) {
-        auto leafIt = g.leafName.find(node);
-        bool isHybrid = g.reticulations.find(node) != g.reticulations.end();
+    auto enter = [&](NodeIndex node, NodeIndex, size_t nth) {
+        if (nth != 0) {
+            f << ", ";
+        }
 
-        if (leafIt != g.leafName.end()) {
-            if (isHybrid) {
+        if (g.isLeaf(node)) {
+            if (g.isReticulation(node)) {
                 bool isFirstOccurrence = hybridFirstOccurrence.find(node) == hybridFirstOccurrence.end();
 
                 if (isFirstOccurrence) {
-                    f << "(" << leafIt->second << ")";
+                    f << '(' << g.getLeafName(node) << ')';
 
                     hybridFirstOccurrence.insert(node);
                 }
 
                 f << hybridStr.at(node);
             } else {
-                f << leafIt->second;
+                f << g.getLeafName(node);
             }
 
-            return;
+            return false;
         }
 
-        size_t numChildren = g.adjList[node].size();
-
-        if (numChildren != 0) {
-            f << "(";
-
-            for (size_t i = 0; i < numChildren; i++) {
-                dfs(g.adjList[node][i]);
+        if (!g.children(node).empty()) {
+            f << '(';
+        }
 
-                if (i != numChildren - 1) {
-                    f << ", ";
-                }
-            }
+        return true;
+    };
 
-            f << ")";
+    auto leave = [&](NodeIndex node, NodeIndex) {
+        if (!g.children(node).empty()) {
+            f << ')';
         }
 
         // if (includeInternalNames) {
         //     res += nodeID;
         // }
 
-        if (isHybrid) {
+        if (g.isReticulation(node)) {
             f << hybridStr.at(node);
         }
     };
 
+    g.walk(g.root, [](NodeIndex, NodeIndex) { return true; }, enter, leave);
+    f << ';';
 
-    dfs(g.root);
-    f << ";";
-
-    f.close();
+    if (!f.close()) {
+        std::cerr << "Failed to save to '" << filename << "'."<< std::endl;
+        std::exit(EXIT_FAILURE);
+    }
 }
@@ -1,8 +1,38 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
+#include <string_view>
 
+#include "inputFile.h"
 #include "../graph.h"
 
-bool openENWK(Graph &g, const std::string &file);
+bool isENWK(std::string_view data);
+// Reads only the first network of the file.
+bool openENWK(Graph &g, std::string_view data);
+// Reads the first network of data, then drops it from the front of data.
+bool readENWK(Graph &g, std::string_view &data);
 void saveENWK(const Graph &g, const std::string &filename);
+
+// Reads a file holding many networks, each ended by a `;`,
+// one network at a time.
+struct ENWKStream {
+public:
+    bool open(const std::string &file);
+
+    // Reads and freezes the next network. Returns false once there are
+    // none left, or if it couldn't be parsed (see failed).
+    bool next(Graph &g);
+    bool failed() const { return error; }
+    // Networks read so far, counting the one that failed.
+    size_t numRead() const { return count; }
+
+private:
+    InputFile data;
+    std::string filename;
+    const char *pos = nullptr;
+    const char *end = nullptr;
+
+    size_t count = 0;
+    bool error = false;
+};
@@ -2,17 +2,20 @@
 #include "formatType.h"
 
 #include <iostream>
+#include <string_view>
 
 #include "gml.h"
 #include "eNewick.h"
 #include "admixture.h"
 #include "treemix.h"
+#include "snapshot.h"
 
 Format formats[static_cast<size_t>(FormatType::NUM)] = {
     {
         FormatType::GML,
         "GML",
         {".gml"},
+        isGML,
         openGML,
         saveGML
     },
@@ -20,6 +23,7 @@ Format formats[static_cast<size_t>(FormatType::NUM)] = {
         FormatType::ENWK,
         "ENWK",
         {".enwk", ".ewk"},
+        isENWK,
         openENWK,
         saveENWK
     },
@@ -27,18 +31,49 @@ Format formats[static_cast<size_t>(FormatType::NUM)] = {
         FormatType::ADMIX,
         "ADMIX",
         {".admix"},
+        isADMIX,
         openADMIX,
         saveADMIX
     },
-{
+    {
         FormatType::TREEMIX,
         "TREEMIX",
         {".treemix"},
+        isTreemix,
         openTreemix,
         saveTreemix
+    },
+    {
+        FormatType::SNAPSHOT,
+        "SNAP",
+        {".pgsnap"},
+        isSNAP,
+        openSNAP,
+        saveSNAP
     }
 };
 
+// SNAP goes first: its magic number is exact, while the text formats'
+// sniffers are guesses that binary data could happen to pass.
+const FormatType sniffOrder[NUM_FORMATS] = {
+    FormatType::SNAPSHOT,
+    FormatType::GML,
+    FormatType::ENWK,
+    FormatType::ADMIX,
+    FormatType::TREEMIX
+};
+
+std::string_view sniffHead(std::string_view data) {
+    data = data.substr(0, SNIFF_BYTES);
+    size_t start = data.find_first_not_of(" \t\r\n");
+
+    if (start == std::string_view::npos) {
+        return {};
+    }
+
+    return data.substr(start);
+}
+
 void printFormats() {
     std::cout << "FORMATS:" << std::endl;
 
@@ -2,17 +2,25 @@
 
 #include <array>
 #include <string>
+#include <string_view>
 
 #include "formatType.h"
 #include "../graph.h"
 
 #define NUM_EXTENSIONS 3
 
+// Files without a known extension are matched by their first bytes.
+const size_t SNIFF_BYTES = 512;
+
 struct Format {
     FormatType type;
     std::string name;
     std::array<std::string, NUM_EXTENSIONS> exts;
-    bool (*open)(Graph &, const std::string &);
+    // Whether the file's contents look like this format. Only looks at
+    // the first SNIFF_BYTES, unless noted otherwise.
+    bool (*sniff)(std::string_view);
+    // Parses the whole file, already read into memory.
+    bool (*open)(Graph &, std::string_view);
     void (*save)(const Graph &, const std::string &);
 };
 
@@ -20,4 +28,11 @@ const size_t NUM_FORMATS = static_cast<size_t>(FormatType::NUM);
 
 extern Format formats[NUM_FORMATS];
 
+// The order files without a known extension are sniffed in.
+extern const FormatType sniffOrder[NUM_FORMATS];
+
+// The part of the file sniffers look at: its first SNIFF_BYTES,
+// from the first byte that isn't whitespace.
+std::string_view sniffHead(std::string_view data);
+
 void printFormats();
@@ -6,5 +6,6 @@ enum class FormatType {
     ENWK,
     ADMIX,
     TREEMIX,
+    SNAPSHOT,
     NUM
 };
@@ -4,14 +4,16 @@
 #include <cctype>
 #include <cstdint>
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
+#include "format.h"
+#include "outputFile.h"
+#include "scan.h"
+
 enum class TokenType {
     OPEN_BRACKET,
     CLOSE_BRACKET,
@@ -22,27 +24,38 @@ enum class TokenType {
     ATTRIBUTE_NAME,
     ATTRIBUTE_STRING,
     ATTRIBUTE_NUMBER,
+    END,
 };
 
 struct Token {
     TokenType type;
-    std::string value;
+    std::string_view value;
 };
 
-static std::vector<Token> tokenize(std::ifstream &f) {
-    std::vector<Token> tokens;
-    char c;
+static const ByteClass WORD_CHARS("", true, false);
+static const ByteClass NUMBER_CHARS("-.", false, true);
+static const ByteClass QUOTE("\"", false, false);
+static const ByteClass BLOCK_CHARS("[]\"", false, false);
+// Everything the lexer acts on, the rest is skipped.
+static const ByteClass TOKEN_STARTS("[]\"-.", true, true);
+
+// Hands out one token at a time, straight from the file. Tokens are
+// views into it, so nothing is copied or kept around.
+struct Lexer {
+public:
+    Token next() {
+        pos = findFirst(TOKEN_STARTS, pos, end);
+
+        if (pos == end) {
+            return last = {TokenType::END, {}};
+        }
 
-    while (f.get(c)) {
-        if (isalpha(c)) {
-            std::string word = {c};
+        char c = *pos;
+        const char *start = pos;
 
-            int n = f.peek();
-            while (n != EOF && isalpha(n)) {
-                f.get(c);
-                word += c;
-                n = f.peek();
-            }
+        if (isalpha(c)) {
+            pos = findFirstNot(WORD_CHARS, pos + 1, end);
+            std::string_view word(start, pos - start);
 
             TokenType t;
             if (word == "graph") {
@@ -53,265 +66,434 @@ static std::vector<Token> tokenize(std::ifstream &f) {
                 t = TokenType::NODE;
             } else if (word == "edge") {
                 t = TokenType::EDGE;
-            } else if (!tokens.empty() && tokens.back().type == TokenType::ATTRIBUTE_NAME) {
+            } else if (last.type == TokenType::ATTRIBUTE_NAME) {
                 t = TokenType::ATTRIBUTE_STRING;
             } else {
                 t = TokenType::ATTRIBUTE_NAME;
             }
 
-            tokens.push_back({t, word});
+            return last = {t, word};
         } else if (c == '[') {
-            tokens.push_back({TokenType::OPEN_BRACKET, "["});
+            pos++;
+            return last = {TokenType::OPEN_BRACKET, "["};
         } else if (c == ']') {
-            tokens.push_back({TokenType::CLOSE_BRACKET, "]"});
+            pos++;
+            return last = {TokenType::CLOSE_BRACKET, "]"};
         } else if (c == '"') {
-            std::string s;
+            start++;
+            pos = findFirst(QUOTE, start, end);
 
-            int n = f.peek();
-            while (n != EOF && n != '"') {
-                f.get(c);
-                s += c;
-                n = f.peek();
+            Token t = {TokenType::ATTRIBUTE_STRING, std::string_view(start, pos - start)};
+
+            if (pos != end) {
+                pos++;
             }
-            f.get(c);
 
-            tokens.push_back({TokenType::ATTRIBUTE_STRING, s});
-        } else if (isdigit(c) || c == '-' || c == '.') {
-            std::string num = {c};
+            return last = t;
+        }
+
+        pos = findFirstNot(NUMBER_CHARS, pos + 1, end);
+        return last = {TokenType::ATTRIBUTE_NUMBER, std::string_view(start, pos - start)};
+    }
 
-            int n = f.peek();
-            while (n != EOF && (isdigit(n) || n == '-' || n == '.')) {
-                f.get(c);
-                num += c;
-                n = f.peek();
+    // Skips to the end of the block whose [ was just read, like the
+    // graphics and styles visualization tools add. Only brackets and
+    // quotes are looked at. Returns false if the file ends first.
+    bool skipBlock() {
+        unsigned int depth = 1;
+
+        while (true) {
+            pos = findFirst(BLOCK_CHARS, pos, end);
+
+            if (pos == end) {
+                return false;
             }
 
-            if (!tokens.empty()
-            &&  tokens.back().type == TokenType::DIRECTED
-            &&  std::stoi(num, nullptr) == 0) {
-                std::cerr << "GML graph is not directed. Please make sure it is directed." << std::endl;
-                std::exit(EXIT_FAILURE);
+            char c = *pos++;
+
+            if (c == '"') {
+                pos = findFirst(QUOTE, pos, end);
+
+                if (pos != end) {
+                    pos++;
+                }
+            } else if (c == '[') {
+                depth++;
+            } else if (--depth == 0) {
+                last = {TokenType::CLOSE_BRACKET, "]"};
+                return true;
             }
+        }
+    }
+
+public:
+    const char *pos;
+    const char *end;
+    Token last = {TokenType::END, {}};
+};
+
+// Builds the graph from node and edge blocks as they're read.
+struct Builder {
+public:
+    // Nodes are numbered in the order their id is first seen.
+    NodeIndex getIndex(std::string_view id) {
+        auto it = idToIndex.emplace(id, g.adjList.size());
 
-            tokens.push_back({TokenType::ATTRIBUTE_NUMBER, num});
+        if (it.second) {
+            g.addNode();
+            numParents.push_back(0);
         }
+
+        return it.first->second;
     }
 
-    return tokens;
-}
+    void addEdge(NodeIndex source, NodeIndex target) {
+        g.addEdge(source, target);
+        numParents[target]++;
+    }
 
-static bool parse(Graph &g, const std::vector<Token> &tokens) {
-    if (tokens.front().type != TokenType::GRAPH
-    ||  tokens[1].type != TokenType::OPEN_BRACKET) {
-        return false;
+public:
+    Graph &g;
+
+    std::unordered_map<std::string_view, NodeIndex> idToIndex;
+    std::unordered_map<NodeIndex, std::string_view> labels;
+    std::vector<NodeIndex> numParents;
+};
+
+// Reads the value of the attribute whose name was just read. A value
+// that's a whole block isn't used by anything, so it's skipped.
+static bool attributeValue(Lexer &lex, Token &value) {
+    value = lex.next();
+
+    if (value.type == TokenType::OPEN_BRACKET) {
+        return lex.skipBlock();
     }
 
-    uint64_t curIndex = 0;
-    std::unordered_map<std::string, uint64_t> idToIndex;
-    std::unordered_map<uint64_t, std::string> indexToId;
+    return value.type != TokenType::END && value.type != TokenType::CLOSE_BRACKET;
+}
+
+static bool parseNode(Lexer &lex, Builder &b) {
+    std::string_view id;
+    std::string_view label;
+    bool hasId = false;
+    bool hasLabel = false;
 
-    std::unordered_map<uint64_t, std::string> labels;
+    while (true) {
+        Token t = lex.next();
 
-    std::unordered_set<uint64_t> reticulations;
-    std::unordered_map<uint64_t, std::vector<uint64_t>> nodeParents;
+        if (t.type == TokenType::CLOSE_BRACKET) {
+            break;
+        }
 
-    for (size_t i = 2; i < tokens.size(); i++) {
-        if (tokens[i].type == TokenType::NODE) {
-            i++;
+        if (t.type == TokenType::END) {
+            return false;
+        }
 
-            if (tokens[i].type != TokenType::OPEN_BRACKET) {
+        if (t.type == TokenType::OPEN_BRACKET) {
+            if (!lex.skipBlock()) {
                 return false;
             }
 
-            i++;
-            while (tokens[i].type != TokenType::CLOSE_BRACKET) {
-                if (tokens[i].type == TokenType::ATTRIBUTE_NAME) {
-                    std::string attributeName = tokens[i].value;
-                    i++;
-
-                    if (attributeName == "id") {
-                        idToIndex[tokens[i].value] = curIndex;
-                        indexToId[curIndex] = tokens[i].value;
-                        g.addNode();
-
-                        curIndex++;
-                    } else if (attributeName == "label") {
-                        labels[curIndex - 1] = tokens[i].value;
-                    } else if (tokens[i].type == TokenType::OPEN_BRACKET) {
-                        unsigned int bracketCount = 1;
-
-                        while (bracketCount) {
-                            i++;
-
-                            if (tokens[i].type == TokenType::OPEN_BRACKET) {
-                                bracketCount++;
-                            } else if (tokens[i].type == TokenType::CLOSE_BRACKET) {
-                                bracketCount--;
-                            }
-                        }
-                    }
-                }
+            continue;
+        }
 
-                i++;
-            }
-        } else if (tokens[i].type == TokenType::EDGE) {
-            i++;
+        if (t.type != TokenType::ATTRIBUTE_NAME) {
+            continue;
+        }
+
+        Token value;
+
+        if (!attributeValue(lex, value)) {
+            return false;
+        }
+
+        if (t.value == "id") {
+            id = value.value;
+            hasId = true;
+        } else if (t.value == "label") {
+            label = value.value;
+            hasLabel = true;
+        }
+    }
+
+    if (!hasId) {
+        return false;
+    }
+
+    NodeIndex node = b.getIndex(id);
+
+    if (hasLabel) {
+        b.labels[node] = label;
+    }
+
+    return true;
+}
+
+static bool parseEdge(Lexer &lex, Builder &b) {
+    std::string_view source;
+    std::string_view target;
+    bool hasSource = false;
+    bool hasTarget = false;
 
-            if (tokens[i].type != TokenType::OPEN_BRACKET) {
+    while (true) {
+        Token t = lex.next();
+
+        if (t.type == TokenType::CLOSE_BRACKET) {
+            break;
+        }
+
+        if (t.type == TokenType::END) {
+            return false;
+        }
+
+        if (t.type == TokenType::OPEN_BRACKET) {
+            if (!lex.skipBlock()) {
                 return false;
             }
 
-            i++;
-            uint64_t source;
-            uint64_t target;
+            continue;
+        }
 
-            while (tokens[i].type != TokenType::CLOSE_BRACKET) {
-                if (tokens[i].type == TokenType::ATTRIBUTE_NAME) {
-                    std::string attributeName = tokens[i].value;
-                    i++;
+        if (t.type != TokenType::ATTRIBUTE_NAME) {
+            continue;
+        }
 
-                    if (attributeName == "source") {
-                        source = idToIndex[tokens[i].value];
-                    } else if (attributeName == "target") {
-                        target = idToIndex[tokens[i].value];
-                    }
-                }
+        Token value;
+
+        if (!attributeValue(lex, value)) {
+            return false;
+        }
+
+        if (t.value == "source") {
+            source = value.value;
+            hasSource = true;
+        } else if (t.value == "target") {
+            target = value.value;
+            hasTarget = true;
+        }
+    }
+
+    if (!hasSource || !hasTarget) {
+        return false;
+    }
+
+    b.addEdge(b.getIndex(source), b.getIndex(target));
+    return true;
+}
+
+// If a reticulation only has an edge to a leaf, turns said reticulation
+// into that leaf and removes the unnecessary edge and node. The nodes
+// after a removed one shift down, which is done once for all of them
+// through newIndex. Also fills in g.reticulations.
+static void normalizeReticulations(Builder &b) {
+    Graph &g = b.g;
+    size_t numNodes = g.adjList.size();
+    std::vector<char> removed(numNodes, false);
+    bool anyRemoved = false;
+
+    for (size_t r = 0; r < numNodes; r++) {
+        if (b.numParents[r] < 2 || g.adjList[r].size() != 1) {
+            continue;
+        }
+
+        NodeIndex c = g.adjList[r][0];
+
+        // A leaf with other parents has to stay.
+        if (!g.adjList[c].empty() || b.numParents[c] != 1) {
+            continue;
+        }
+
+        b.labels[r] = b.labels[c];
+        b.labels.erase(c);
+
+        g.adjList[r].clear();
+        removed[c] = true;
+        anyRemoved = true;
+    }
+
+    std::vector<NodeIndex> newIndex(numNodes);
+    NodeIndex next = 0;
+
+    for (size_t n = 0; n < numNodes; n++) {
+        newIndex[n] = next;
+
+        if (!removed[n]) {
+            next++;
+        }
+    }
 
-                i++;
+    if (anyRemoved) {
+        for (size_t n = 0; n < numNodes; n++) {
+            if (removed[n]) {
+                continue;
             }
 
-            nodeParents[target].push_back(source);
+            for (NodeIndex &e : g.adjList[n]) {
+                e = newIndex[e];
+            }
 
-            if (nodeParents[target].size() >= 2) {
-                reticulations.insert(target);
+            if (newIndex[n] != n) {
+                g.adjList[newIndex[n]] = std::move(g.adjList[n]);
             }
+        }
+
+        g.adjList.resize(next);
+
+        std::unordered_map<NodeIndex, std::string_view> newLabels;
+        newLabels.reserve(b.labels.size());
 
-            g.addEdge(source, target);
+        for (const auto &p : b.labels) {
+            newLabels[newIndex[p.first]] = p.second;
         }
+
+        b.labels = std::move(newLabels);
     }
 
-    for (const uint64_t &r : reticulations) {
-        g.reticulations[r] = nodeParents[r];
+    std::vector<char> isReticulation(next, false);
 
-        // If a reticulation only has an edge to a leaf,
-        // turn said reticulation into that leaf and remove
-        // the unnecessary edge.
-        if (g.adjList[r].size() == 1) {
-            u_int64_t c = g.adjList[r][0];
+    for (size_t r = 0; r < numNodes; r++) {
+        if (b.numParents[r] >= 2) {
+            isReticulation[newIndex[r]] = true;
+            g.reticulations[newIndex[r]];
+        }
+    }
 
-            if (g.adjList[c].empty()) {
-                labels[r] = labels[c];
-                labels.erase(c);
+    for (size_t n = 0; n < next; n++) {
+        for (const NodeIndex &e : g.adjList[n]) {
+            if (isReticulation[e]) {
+                g.reticulations[e].push_back(n);
+            }
+        }
+    }
+}
 
-                g.adjList[r].pop_back();
+static bool parse(Graph &g, Lexer &lex) {
+    Token t = lex.next();
 
-                for (std::vector<u_int64_t> &n : g.adjList) {
-                    for (u_int64_t &e : n) {
-                        if (e > c) {
-                            e--;
-                        }
-                    }
-                }
+    // Attributes like Creator can come before the graph.
+    while (t.type == TokenType::ATTRIBUTE_NAME) {
+        Token value;
+
+        if (!attributeValue(lex, value)) {
+            return false;
+        }
+
+        t = lex.next();
+    }
 
-                g.adjList.erase(g.adjList.begin() + c);
+    if (t.type != TokenType::GRAPH
+    ||  lex.next().type != TokenType::OPEN_BRACKET) {
+        return false;
+    }
 
-                std::unordered_map<uint64_t, std::string> temp;
+    Builder b = {g};
 
-                for (const auto &p : labels) {
-                    u_int64_t key = p.first;
+    while (true) {
+        t = lex.next();
 
-                    if (p.first > c) {
-                        key--;
-                    }
+        // A missing final ] is let through.
+        if (t.type == TokenType::END || t.type == TokenType::CLOSE_BRACKET) {
+            break;
+        }
 
-                    temp[key] = p.second;
-                }
+        if (t.type == TokenType::NODE || t.type == TokenType::EDGE) {
+            if (lex.next().type != TokenType::OPEN_BRACKET) {
+                return false;
+            }
 
-                labels = std::move(temp);
+            if (!(t.type == TokenType::NODE ? parseNode(lex, b) : parseEdge(lex, b))) {
+                return false;
+            }
+        } else if (t.type == TokenType::DIRECTED) {
+            Token value = lex.next();
+
+            if (value.type == TokenType::ATTRIBUTE_NUMBER
+            &&  std::strtol(std::string(value.value).c_str(), nullptr, 10) == 0) {
+                std::cerr << "GML graph is not directed. Please make sure it is directed." << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+        } else if (t.type == TokenType::OPEN_BRACKET) {
+            if (!lex.skipBlock()) {
+                return false;
             }
         }
     }
 
+    normalizeReticulations(b);
+
     for (size_t i = 0; i < g.adjList.size(); i++) {
         if (g.adjList[i].empty()) {
             g.leaves.push_back(i);
-            // g.leafName[i] = indexToId[i];
-            g.leafName[i] = labels[i];
+            g.leafName[i] = std::string(b.labels[i]);
         }
     }
 
     return true;
 }
 
-bool openGML(Graph &g, const std::string &file) {
-    std::ifstream f(file);
+bool isGML(std::string_view data) {
+    std::string_view head = sniffHead(data);
+
+    if (head.empty() || head[0] == '(') {
+        return false;
+    }
+
+    size_t pos = head.find("graph");
 
-    if (!f.is_open()) {
+    if (pos == std::string_view::npos) {
         return false;
     }
 
-    std::vector<Token> tokens = tokenize(f);
-    f.close();
+    size_t open = head.find_first_not_of(" \t\r\n", pos + 5);
 
-    return parse(g, tokens);
+    return open != std::string_view::npos && head[open] == '[';
+}
+
+bool openGML(Graph &g, std::string_view data) {
+    Lexer lex = {data.data(), data.data() + data.size()};
+
+    return parse(g, lex);
 }
 
 void saveGML(const Graph &g, const std::string &filename) {
-    std::ofstream f(filename);
+    OutputFile f;
 
-    if (!f) {
+    if (!f.open(filename)) {
         std::cerr << "Failed to save to '" << filename << "'."<< std::endl;
         std::exit(EXIT_FAILURE);
     }
 
-    std::ostringstream edges;
+    const std::string_view indent = "    ";
+    const std::string_view innerIndent = "        ";
 
-    std::string indent = "    ";
+    f << "graph [\n";
+    f << indent << "directed 1\n";
 
-    f << "graph [" << std::endl;
-    f << indent << "directed 1" << std::endl;
-    
-    for (size_t i = 0; i < g.adjList.size(); i++) {
-        f << indent << "node [" << std::endl;
-        indent += "    ";
+    for (size_t i = 0; i < g.getNumNodes(); i++) {
+        f << indent << "node [\n";
+        f << innerIndent << "id " << i << '\n';
 
-        f << indent << "id " << i << std::endl;
-
-        auto nodeIt = g.leafName.find(i);
-
-        if (nodeIt != g.leafName.end()) {
-            f << indent << "label \"";
-            f << nodeIt->second;
-            f << "\"" << std::endl;
+        if (g.isLeaf(i)) {
+            f << innerIndent << "label \"" << g.getLeafName(i) << "\"\n";
         }
 
-        indent = indent.substr(0, indent.length() - 4);
-        f << indent << "]" << std::endl;
-
-        for (const auto &t : g.adjList[i]) {
-            edges << indent << "edge [" << std::endl;
-            indent += "    ";
-
-            edges << indent << "source " << i << std::endl;
-
-            edges << indent << "target " << t << std::endl;
-            /* edges << indent << "target ";
-            auto targetIt = g.leafName.find(t);
-
-            if (targetIt != g.leafName.end()) {
-                edges << targetIt->second;
-            } else {
-                edges << t;
-            }
-            edges << std::endl; */
+        f << indent << "]\n";
+    }
 
-            indent = indent.substr(0, indent.length() - 4);
-            edges << indent << "]" << std::endl;
+    // All the edges go after all the nodes.
+    for (size_t i = 0; i < g.getNumNodes(); i++) {
+        for (const auto &t : g.children(i)) {
+            f << indent << "edge [\n";
+            f << innerIndent << "source " << i << '\n';
+            f << innerIndent << "target " << t << '\n';
+            f << indent << "]\n";
         }
     }
 
-    f << edges.str();
     f << "]";
 
-    f.close();
+    if (!f.close()) {
+        std::cerr << "Failed to save to '" << filename << "'."<< std::endl;
+        std::exit(EXIT_FAILURE);
+    }
 }
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 #include "../graph.h"
 
-bool openGML(Graph &g, const std::string &file);
+bool isGML(std::string_view data);
+bool openGML(Graph &g, std::string_view data);
 void saveGML(const Graph &g, const std::string &filename);
@@ -0,0 +1,191 @@
+#include "inputFile.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+static const unsigned char GZIP_MAGIC[] = {0x1f, 0x8b};
+static const unsigned char ZSTD_MAGIC[] = {0x28, 0xb5, 0x2f, 0xfd};
+
+static const char *COMPRESSION_EXTS[] = {".gz", ".zst"};
+
+template <size_t N>
+static bool startsWith(std::string_view data, const unsigned char (&magic)[N]) {
+    return data.size() >= N && std::memcmp(data.data(), magic, N) == 0;
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+// The output grows by at least this much whenever it fills up.
+static const size_t CHUNK = size_t(1) << 20;
+
+// Makes room for at least CHUNK more bytes after the first used ones.
+static void grow(std::string &out, size_t used) {
+    if (out.size() - used < CHUNK) {
+        out.resize(std::max(out.size() * 2, used + CHUNK));
+    }
+}
+#endif
+
+#ifdef HAVE_ZLIB
+static bool gunzip(std::string_view in, std::string &out) {
+    z_stream z = {};
+
+    // 32 lets zlib take either a gzip or a zlib header.
+    if (inflateInit2(&z, 15 + 32) != Z_OK) {
+        return false;
+    }
+
+    // The last 4 bytes are the size of the last member, mod 2^32,
+    // a good first guess for the whole file. They're whatever the file
+    // says though, so the guess is capped and out grows from there if it
+    // was short.
+    uint32_t hint = 0;
+    std::memcpy(&hint, in.data() + in.size() - std::min<size_t>(in.size(), 4), std::min<size_t>(in.size(), 4));
+    out.resize(std::max<size_t>(std::min<size_t>(hint, in.size() * 4), CHUNK));
+
+    size_t used = 0;
+    int res = Z_OK;
+
+    z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+
+    // zlib counts in 32 bits, so big inputs go in several pieces.
+    const size_t MAX_IN = UINT32_MAX;
+    size_t inLeft = in.size();
+
+    while (true) {
+        if (z.avail_in == 0 && inLeft != 0) {
+            z.avail_in = std::min(inLeft, MAX_IN);
+            inLeft -= z.avail_in;
+        }
+
+        grow(out, used);
+        z.next_out = reinterpret_cast<Bytef *>(&out[used]);
+        z.avail_out = std::min(out.size() - used, MAX_IN);
+
+        size_t before = z.avail_out;
+        res = inflate(&z, Z_NO_FLUSH);
+        used += before - z.avail_out;
+
+        if (res == Z_STREAM_END) {
+            // gzip files can be several members one after the other.
+            if (z.avail_in == 0 && inLeft == 0) {
+                break;
+            }
+
+            res = inflateReset(&z);
+        }
+
+        if (res != Z_OK) {
+            break;
+        }
+    }
+
+    inflateEnd(&z);
+    out.resize(used);
+
+    return res == Z_STREAM_END;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static bool unzstd(std::string_view in, std::string &out) {
+    ZSTD_DStream *z = ZSTD_createDStream();
+
+    if (z == nullptr) {
+        return false;
+    }
+
+    unsigned long long hint = ZSTD_getFrameContentSize(in.data(), in.size());
+
+    // The frame header's size is whatever the file says, so it's capped
+    // like gunzip's guess. That also covers ZSTD_CONTENTSIZE_UNKNOWN and
+    // ZSTD_CONTENTSIZE_ERROR, which are the two largest values.
+    out.resize(std::max<size_t>(std::min<unsigned long long>(hint, in.size() * 4), CHUNK));
+
+    ZSTD_inBuffer inBuf = {in.data(), in.size(), 0};
+    size_t used = 0;
+    // 0 once a frame is done and all of it has been written out.
+    size_t res = 1;
+
+    while (inBuf.pos < inBuf.size || res != 0) {
+        grow(out, used);
+        ZSTD_outBuffer outBuf = {&out[used], out.size() - used, 0};
+
+        res = ZSTD_decompressStream(z, &outBuf, &inBuf);
+        used += outBuf.pos;
+
+        if (ZSTD_isError(res)) {
+            break;
+        }
+
+        // Out of input in the middle of a frame.
+        if (inBuf.pos == inBuf.size && outBuf.pos == 0 && res != 0) {
+            break;
+        }
+    }
+
+    ZSTD_freeDStream(z);
+    out.resize(used);
+
+    return res == 0;
+}
+#endif
+
+bool InputFile::open(const std::string &file) {
+    if (!mapped.open(file)) {
+        return false;
+    }
+
+    std::string_view raw = mapped.data();
+    view = raw;
+
+    if (startsWith(raw, GZIP_MAGIC)) {
+#ifdef HAVE_ZLIB
+        if (!gunzip(raw, decompressed)) {
+            return false;
+        }
+#else
+        std::cerr << "This build can't read gzip files, it was made without zlib." << std::endl;
+        return false;
+#endif
+    } else if (startsWith(raw, ZSTD_MAGIC)) {
+#ifdef HAVE_ZSTD
+        if (!unzstd(raw, decompressed)) {
+            return false;
+        }
+#else
+        std::cerr << "This build can't read zstd files, it was made without libzstd." << std::endl;
+        return false;
+#endif
+    } else {
+        return true;
+    }
+
+    view = decompressed;
+
+    return true;
+}
+
+std::string withoutCompressionExt(const std::string &file) {
+    for (const char *ext : COMPRESSION_EXTS) {
+        size_t len = std::strlen(ext);
+
+        if (file.size() > len && file.compare(file.size() - len, len, ext) == 0) {
+            return file.substr(0, file.size() - len);
+        }
+    }
+
+    return file;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "mappedFile.h"
+
+// A whole input file, decompressed first if it's gzip or zstd
+// compressed, which is told by its first bytes. Plain files are
+// only mapped.
+// The view stays valid until the InputFile is destroyed.
+struct InputFile {
+public:
+    // Returns false if the file couldn't be opened or decompressed,
+    // or if it's compressed in a way this build can't read.
+    bool open(const std::string &file);
+
+    std::string_view data() const { return view; }
+
+private:
+    MappedFile mapped;
+    std::string decompressed;
+    std::string_view view;
+};
+
+// The file name without a trailing .gz or .zst.
+std::string withoutCompressionExt(const std::string &file);
@@ -0,0 +1,49 @@
+#include "mappedFile.h"
+
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    if (size != 0) {
+        munmap(const_cast<char *>(begin), size);
+    }
+}
+
+bool MappedFile::open(const std::string &file) {
+    int fd = ::open(file.c_str(), O_RDONLY);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+
+    // mmap refuses empty files, an empty view is all they need.
+    if (st.st_size == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+
+    begin = static_cast<const char *>(mapped);
+    size = st.st_size;
+
+    return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// A read-only view of a whole file, mapped into memory.
+// The view stays valid until the MappedFile is destroyed.
+struct MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    // Returns false if the file couldn't be opened or mapped.
+    bool open(const std::string &file);
+
+    std::string_view data() const { return {begin, size}; }
+
+private:
+    const char *begin = nullptr;
+    size_t size = 0;
+};
@@ -0,0 +1,91 @@
+#include "outputFile.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+OutputFile::~OutputFile() {
+    close();
+}
+
+bool OutputFile::open(const std::string &file) {
+    fd = ::open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1) {
+        return false;
+    }
+
+    buffer.reset(new char[BUFFER_BYTES]);
+    used = 0;
+    error = false;
+
+    return true;
+}
+
+bool OutputFile::close() {
+    if (fd == -1) {
+        return !error;
+    }
+
+    flush();
+
+    if (::close(fd) == -1) {
+        error = true;
+    }
+
+    fd = -1;
+    buffer.reset();
+
+    return !error;
+}
+
+void OutputFile::writeAll(const char *data, size_t bytes) {
+    while (bytes != 0 && !error) {
+        ssize_t n = ::write(fd, data, bytes);
+
+        if (n == -1) {
+            if (errno != EINTR) {
+                error = true;
+            }
+
+            continue;
+        }
+
+        data += n;
+        bytes -= n;
+    }
+}
+
+void OutputFile::flush() {
+    writeAll(buffer.get(), used);
+    used = 0;
+}
+
+void OutputFile::write(const void *data, size_t bytes) {
+    // Big blocks skip the buffer.
+    if (bytes >= BUFFER_BYTES) {
+        flush();
+        writeAll(static_cast<const char *>(data), bytes);
+
+        return;
+    }
+
+    if (BUFFER_BYTES - used < bytes) {
+        flush();
+    }
+
+    std::memcpy(buffer.get() + used, data, bytes);
+    used += bytes;
+}
+
+void OutputFile::padded(std::string_view s, size_t width) {
+    *this << s;
+
+    for (size_t i = s.size(); i < width; i++) {
+        *this << ' ';
+    }
+}
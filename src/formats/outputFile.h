@@ -0,0 +1,69 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// A file being written, which gathers everything in a large buffer and
+// hands it to the OS a block at a time. Nothing is flushed per line.
+struct OutputFile {
+public:
+    OutputFile() = default;
+    OutputFile(const OutputFile &) = delete;
+    OutputFile &operator=(const OutputFile &) = delete;
+    // Closes the file if close wasn't called.
+    ~OutputFile();
+
+    // Returns false if the file couldn't be created.
+    bool open(const std::string &file);
+    // Writes out what's left in the buffer. Returns false if any
+    // write to the file failed.
+    bool close();
+
+    void write(const void *data, size_t bytes);
+
+    OutputFile &operator<<(std::string_view s) {
+        write(s.data(), s.size());
+        return *this;
+    }
+
+    OutputFile &operator<<(char c) {
+        if (used == BUFFER_BYTES) {
+            flush();
+        }
+
+        buffer[used++] = c;
+        return *this;
+    }
+
+    // Integers are formatted straight into the buffer, without a locale.
+    template <typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+    OutputFile &operator<<(T n) {
+        if (BUFFER_BYTES - used < MAX_NUMBER_CHARS) {
+            flush();
+        }
+
+        used = std::to_chars(buffer.get() + used, buffer.get() + BUFFER_BYTES, n).ptr - buffer.get();
+        return *this;
+    }
+
+    // Writes s, then spaces up to width, like std::left and std::setw.
+    void padded(std::string_view s, size_t width);
+
+private:
+    void writeAll(const char *data, size_t bytes);
+    void flush();
+
+private:
+    static const size_t BUFFER_BYTES = size_t(1) << 20;
+    static const size_t MAX_NUMBER_CHARS = 64;
+
+    int fd = -1;
+    bool error = false;
+
+    std::unique_ptr<char[]> buffer;
+    size_t used = 0;
+};
@@ -0,0 +1,196 @@
+#include "scan.h"
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+ByteClass::ByteClass(const char *c, bool letters, bool digits)
+    : numChars(0), letters(letters), digits(digits) {
+    std::memset(table, 0, sizeof(table));
+
+    for (; *c != '\0' && numChars < MAX_CHARS; c++) {
+        chars[numChars++] = *c;
+        table[static_cast<unsigned char>(*c)] = true;
+    }
+
+    // Only ASCII, like isalpha and isdigit in the C locale.
+    for (unsigned int b = 0; b < 128; b++) {
+        if ((letters && ((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z')))
+        ||  (digits && b >= '0' && b <= '9')) {
+            table[b] = true;
+        }
+    }
+}
+
+typedef const char *(*FindFunc)(const ByteClass &, const char *, const char *);
+
+template <bool IN_CLASS>
+static const char *findScalar(const ByteClass &c, const char *pos, const char *end) {
+    while (pos != end && c.contains(*pos) != IN_CLASS) {
+        pos++;
+    }
+
+    return pos;
+}
+
+#ifdef SCAN_X86
+
+// Bytes >= 0x80 are negative as signed chars, so the range checks below
+// never let them in, same as the table.
+
+// SSE2 is part of x86-64, so it needs no check.
+static inline unsigned int classMask16(const ByteClass &c, __m128i v) {
+    __m128i m = _mm_setzero_si128();
+
+    for (size_t i = 0; i < c.numChars; i++) {
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(c.chars[i])));
+    }
+
+    if (c.letters) {
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        m = _mm_or_si128(m, _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                          _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1))));
+    }
+
+    if (c.digits) {
+        m = _mm_or_si128(m, _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                          _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1))));
+    }
+
+    return _mm_movemask_epi8(m);
+}
+
+template <bool IN_CLASS>
+static const char *findSSE2(const ByteClass &c, const char *pos, const char *end) {
+    while (end - pos >= 16) {
+        unsigned int mask = classMask16(c, _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos)));
+
+        if (!IN_CLASS) {
+            mask ^= 0xFFFF;
+        }
+
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+
+        pos += 16;
+    }
+
+    return findScalar<IN_CLASS>(c, pos, end);
+}
+
+__attribute__((target("avx2")))
+static inline unsigned int classMask32(const ByteClass &c, __m256i v) {
+    __m256i m = _mm256_setzero_si256();
+
+    for (size_t i = 0; i < c.numChars; i++) {
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c.chars[i])));
+    }
+
+    if (c.letters) {
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        m = _mm256_or_si256(m, _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                                                _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower)));
+    }
+
+    if (c.digits) {
+        m = _mm256_or_si256(m, _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+                                                _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v)));
+    }
+
+    return _mm256_movemask_epi8(m);
+}
+
+template <bool IN_CLASS>
+__attribute__((target("avx2")))
+static const char *findAVX2(const ByteClass &c, const char *pos, const char *end) {
+    while (end - pos >= 32) {
+        unsigned int mask = classMask32(c, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos)));
+
+        if (!IN_CLASS) {
+            mask = ~mask;
+        }
+
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+
+        pos += 32;
+    }
+
+    return findSSE2<IN_CLASS>(c, pos, end);
+}
+
+template <bool IN_CLASS>
+static FindFunc pickFind() {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        return findAVX2<IN_CLASS>;
+    }
+
+    return findSSE2<IN_CLASS>;
+}
+
+#else
+
+template <bool IN_CLASS>
+static FindFunc pickFind() {
+    return findScalar<IN_CLASS>;
+}
+
+#endif
+
+static const FindFunc findIn = pickFind<true>();
+static const FindFunc findOut = pickFind<false>();
+
+const char *scanFirst(const ByteClass &c, const char *pos, const char *end) {
+    return findIn(c, pos, end);
+}
+
+const char *scanFirstNot(const ByteClass &c, const char *pos, const char *end) {
+    return findOut(c, pos, end);
+}
+
+static const ByteClass NEWLINE("\n", false, false);
+static const ByteClass BLANKS(" \t\r", false, false);
+
+bool nextLine(std::string_view &data, std::string_view &line) {
+    if (data.empty()) {
+        return false;
+    }
+
+    const char *begin = data.data();
+    const char *end = begin + data.size();
+    const char *newline = findFirst(NEWLINE, begin, end);
+
+    line = std::string_view(begin, newline - begin);
+    data = newline == end ? std::string_view() : std::string_view(newline + 1, end - newline - 1);
+
+    return true;
+}
+
+size_t splitFields(std::string_view line, std::string_view *fields, size_t maxFields) {
+    const char *pos = line.data();
+    const char *end = pos + line.size();
+    size_t count = 0;
+
+    while (count < maxFields) {
+        pos = findFirstNot(BLANKS, pos, end);
+
+        if (pos == end) {
+            break;
+        }
+
+        const char *start = pos;
+        pos = findFirst(BLANKS, pos, end);
+        fields[count++] = std::string_view(start, pos - start);
+    }
+
+    return count;
+}
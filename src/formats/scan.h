@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// A set of bytes the text lexers look for, like the structural
+// characters of a format or the characters a name can be made of.
+struct ByteClass {
+public:
+    // Up to MAX_CHARS single characters, plus every ASCII letter
+    // and/or digit if asked for.
+    ByteClass(const char *chars, bool letters, bool digits);
+
+    bool contains(char c) const { return table[static_cast<unsigned char>(c)]; }
+
+public:
+    static const size_t MAX_CHARS = 8;
+
+    bool table[256];
+
+    char chars[MAX_CHARS];
+    size_t numChars;
+    bool letters;
+    bool digits;
+};
+
+// Same as findFirst and findFirstNot below, but look at 16 or 32 bytes
+// at a time when the CPU supports it.
+const char *scanFirst(const ByteClass &c, const char *pos, const char *end);
+const char *scanFirstNot(const ByteClass &c, const char *pos, const char *end);
+
+// Most spans are only a few bytes long, which the table gets through
+// faster than a vector load, so the first few bytes are checked here.
+const size_t SHORT_SPAN = 8;
+
+// Returns the first byte of [pos, end) in the class, end if there's none.
+inline const char *findFirst(const ByteClass &c, const char *pos, const char *end) {
+    for (size_t i = 0; i < SHORT_SPAN; i++, pos++) {
+        if (pos == end || c.contains(*pos)) {
+            return pos;
+        }
+    }
+
+    return scanFirst(c, pos, end);
+}
+
+// Returns the first byte of [pos, end) not in the class, end if there's none.
+inline const char *findFirstNot(const ByteClass &c, const char *pos, const char *end) {
+    for (size_t i = 0; i < SHORT_SPAN; i++, pos++) {
+        if (pos == end || !c.contains(*pos)) {
+            return pos;
+        }
+    }
+
+    return scanFirstNot(c, pos, end);
+}
+
+// Takes the next line off the front of data, without its '\n'.
+// Returns false once data is empty.
+bool nextLine(std::string_view &data, std::string_view &line);
+
+// Splits the line at runs of spaces and tabs, in place. Fills in at most
+// maxFields fields and returns how many it found.
+size_t splitFields(std::string_view line, std::string_view *fields, size_t maxFields);
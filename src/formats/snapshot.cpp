@@ -0,0 +1,319 @@
+#include "snapshot.h"
+#include "../graph.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "outputFile.h"
+
+
+// A frozen graph written out as is, so it can be loaded without parsing.
+// Everything is in the byte order of the machine that wrote it, indices
+// are NodeIndex sized (indexBytes), and every section starts on an
+// 8 byte boundary:
+//
+// Header
+// index childOffsets[numNodes + 1], childTargets[numEdges]
+// index parentOffsets[numNodes + 1], parentTargets[numEdges]
+// index leaves[numLeaves]
+// uint64 nameOffsets[numLeaves + 1], char names[nameBytes] (padded)
+// index reticulationNodes[numReticulations]
+// float edgeWeights[numEdgeWeights], admixProportions[numAdmixProportions]
+//
+// The two float sections follow childTargets and are either empty or
+// hold one value per edge.
+
+static const char MAGIC[8] = {'P', 'G', 'U', 'S', 'N', 'A', 'P', '\0'};
+static const uint32_t VERSION = 3;
+static const uint32_t ENDIAN_MARK = 0x01020304;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t indexBytes;
+    uint32_t reserved;
+
+    uint64_t numNodes;
+    uint64_t numEdges;
+    uint64_t numLeaves;
+    uint64_t numReticulations;
+    uint64_t nameBytes;
+    uint64_t root;
+    uint64_t numEdgeWeights;
+    uint64_t numAdmixProportions;
+};
+
+static uint64_t padded(uint64_t bytes) {
+    return (bytes + 7) & ~uint64_t(7);
+}
+
+// Reads sections out of the mapped file, failing once it runs out.
+struct Reader {
+public:
+    // Returns where the next section starts and moves past it,
+    // nullptr if the file is too short.
+    const char *take(uint64_t bytes) {
+        uint64_t size = padded(bytes);
+
+        if (size < bytes || size > static_cast<uint64_t>(end - pos)) {
+            return nullptr;
+        }
+
+        const char *res = pos;
+        pos += size;
+        return res;
+    }
+
+    bool read(void *out, uint64_t bytes) {
+        const char *data = take(bytes);
+
+        if (data == nullptr) {
+            return false;
+        }
+
+        std::memcpy(out, data, bytes);
+        return true;
+    }
+
+    template <typename T>
+    bool read(std::vector<T> &out, uint64_t count) {
+        if (count > static_cast<uint64_t>(end - pos) / sizeof(T)) {
+            return false;
+        }
+
+        out.resize(count);
+        return read(out.data(), count * sizeof(T));
+    }
+
+public:
+    const char *pos;
+    const char *end;
+};
+
+template <typename T>
+static bool isOffsets(const std::vector<T> &offsets, uint64_t last) {
+    for (size_t i = 0; i + 1 < offsets.size(); i++) {
+        if (offsets[i] > offsets[i + 1]) {
+            return false;
+        }
+    }
+
+    return offsets.front() == 0 && offsets.back() == last;
+}
+
+static bool areNodes(const std::vector<NodeIndex> &nodes, uint64_t numNodes) {
+    for (const NodeIndex &n : nodes) {
+        if (n >= numNodes) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Checks that parentTargets lists the same edges as childTargets, seen
+// from the other end, and that following them never leads back to where
+// it started. The offsets and targets have already been checked.
+static bool isNetwork(const Graph &g) {
+    size_t numNodes = g.childOffsets.size() - 1;
+
+    std::vector<NodeIndex> parents(g.parentTargets.size());
+    std::vector<NodeIndex> next(g.parentOffsets.begin(), g.parentOffsets.end() - 1);
+
+    for (NodeIndex p = 0; p < numNodes; p++) {
+        for (NodeIndex i = g.childOffsets[p]; i < g.childOffsets[p + 1]; i++) {
+            NodeIndex c = g.childTargets[i];
+
+            if (next[c] == g.parentOffsets[c + 1]) {
+                return false;
+            }
+
+            parents[next[c]++] = p;
+        }
+    }
+
+    // Each node's parents were filled in order, and every slot was used
+    // since both sides have the same number of edges.
+    std::vector<NodeIndex> stored;
+    std::vector<NodeIndex> numParents(numNodes);
+
+    for (NodeIndex c = 0; c < numNodes; c++) {
+        auto first = g.parentTargets.begin() + g.parentOffsets[c];
+        auto last = g.parentTargets.begin() + g.parentOffsets[c + 1];
+
+        stored.assign(first, last);
+        std::sort(stored.begin(), stored.end());
+
+        if (!std::equal(stored.begin(), stored.end(), parents.begin() + g.parentOffsets[c])) {
+            return false;
+        }
+
+        numParents[c] = stored.size();
+    }
+
+    std::vector<NodeIndex> ready;
+
+    for (NodeIndex n = 0; n < numNodes; n++) {
+        if (numParents[n] == 0) {
+            ready.push_back(n);
+        }
+    }
+
+    size_t visited = 0;
+
+    while (!ready.empty()) {
+        NodeIndex n = ready.back();
+        ready.pop_back();
+        visited++;
+
+        for (NodeIndex i = g.childOffsets[n]; i < g.childOffsets[n + 1]; i++) {
+            if (--numParents[g.childTargets[i]] == 0) {
+                ready.push_back(g.childTargets[i]);
+            }
+        }
+    }
+
+    return visited == numNodes;
+}
+
+static bool parse(Graph &g, Reader &r) {
+    Header h;
+
+    if (!r.read(&h, sizeof(h))
+    ||  std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0
+    ||  h.version != VERSION
+    ||  h.byteOrder != ENDIAN_MARK) {
+        return false;
+    }
+
+    if (h.indexBytes != sizeof(NodeIndex)) {
+        std::cerr << "The snapshot was saved with " << h.indexBytes * 8 << "-bit node indices, "
+                  << "this build uses " << sizeof(NodeIndex) * 8 << "-bit ones." << std::endl;
+        return false;
+    }
+
+    if (h.numNodes >= NO_INDEX
+    ||  h.numEdges >= NO_INDEX
+    ||  h.root >= h.numNodes
+    ||  (h.numEdgeWeights != 0 && h.numEdgeWeights != h.numEdges)
+    ||  (h.numAdmixProportions != 0 && h.numAdmixProportions != h.numEdges)) {
+        return false;
+    }
+
+    std::vector<uint64_t> nameOffsets;
+
+    if (!r.read(g.childOffsets, h.numNodes + 1)
+    ||  !r.read(g.childTargets, h.numEdges)
+    ||  !r.read(g.parentOffsets, h.numNodes + 1)
+    ||  !r.read(g.parentTargets, h.numEdges)
+    ||  !r.read(g.leaves, h.numLeaves)
+    ||  !r.read(nameOffsets, h.numLeaves + 1)) {
+        return false;
+    }
+
+    const char *names = r.take(h.nameBytes);
+
+    if (names == nullptr
+    ||  !r.read(g.reticulationNodes, h.numReticulations)
+    ||  !r.read(g.edgeWeights, h.numEdgeWeights)
+    ||  !r.read(g.admixProportions, h.numAdmixProportions)
+    ||  !isOffsets(g.childOffsets, h.numEdges)
+    ||  !isOffsets(g.parentOffsets, h.numEdges)
+    ||  !isOffsets(nameOffsets, h.nameBytes)
+    ||  !areNodes(g.childTargets, h.numNodes)
+    ||  !areNodes(g.parentTargets, h.numNodes)
+    ||  !areNodes(g.leaves, h.numNodes)
+    ||  !areNodes(g.reticulationNodes, h.numNodes)
+    ||  g.parentOffsets[h.root] != g.parentOffsets[h.root + 1]
+    ||  !isNetwork(g)) {
+        return false;
+    }
+
+    g.leafNames.resize(h.numLeaves);
+
+    for (uint64_t i = 0; i < h.numLeaves; i++) {
+        g.leafNames[i].assign(names + nameOffsets[i], nameOffsets[i + 1] - nameOffsets[i]);
+    }
+
+    g.root = h.root;
+    g.buildIndex();
+
+    return true;
+}
+
+bool isSNAP(std::string_view data) {
+    return data.size() >= sizeof(MAGIC) && std::memcmp(data.data(), MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool openSNAP(Graph &g, std::string_view data) {
+    Reader r = {data.data(), data.data() + data.size()};
+    return parse(g, r);
+}
+
+static void writeSection(OutputFile &f, const void *data, uint64_t bytes) {
+    static const char zeros[8] = {};
+
+    f.write(static_cast<const char *>(data), bytes);
+    f.write(zeros, padded(bytes) - bytes);
+}
+
+template <typename T>
+static void writeSection(OutputFile &f, const std::vector<T> &v) {
+    writeSection(f, v.data(), v.size() * sizeof(T));
+}
+
+void saveSNAP(const Graph &g, const std::string &filename) {
+    OutputFile f;
+
+    if (!f.open(filename)) {
+        std::cerr << "Failed to save to '" << filename << "'."<< std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::vector<uint64_t> nameOffsets = {0};
+    std::string names;
+
+    for (const std::string &n : g.leafNames) {
+        names += n;
+        nameOffsets.push_back(names.size());
+    }
+
+    Header h = {};
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.byteOrder = ENDIAN_MARK;
+    h.indexBytes = sizeof(NodeIndex);
+    h.numNodes = g.getNumNodes();
+    h.numEdges = g.getNumEdges();
+    h.numLeaves = g.leaves.size();
+    h.numReticulations = g.reticulationNodes.size();
+    h.nameBytes = names.size();
+    h.root = g.root;
+    h.numEdgeWeights = g.edgeWeights.size();
+    h.numAdmixProportions = g.admixProportions.size();
+
+    writeSection(f, &h, sizeof(h));
+    writeSection(f, g.childOffsets);
+    writeSection(f, g.childTargets);
+    writeSection(f, g.parentOffsets);
+    writeSection(f, g.parentTargets);
+    writeSection(f, g.leaves);
+    writeSection(f, nameOffsets);
+    writeSection(f, names.data(), names.size());
+    writeSection(f, g.reticulationNodes);
+    writeSection(f, g.edgeWeights);
+    writeSection(f, g.admixProportions);
+
+    if (!f.close()) {
+        std::cerr << "Failed to save to '" << filename << "'."<< std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "../graph.h"
+
+bool isSNAP(std::string_view data);
+bool openSNAP(Graph &g, std::string_view data);
+void saveSNAP(const Graph &g, const std::string &filename);
@@ -1,189 +1,253 @@
 #include "treemix.h"
 
 #include "eNewick.h"
+#include "format.h"
+#include "scan.h"
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
-#include <fstream>
 #include <iostream>
-#include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
-enum class TokenType {
-    ORIGIN = 4,
-    DESTINATION
-};
+// A migration line: weight, jackknife weight, jackknife se, p-value,
+// then the origin and destination subtrees.
+const size_t NUM_FIELDS = 6;
+const size_t ORIGIN_FIELD = 4;
+const size_t DESTINATION_FIELD = 5;
 
-struct Token {
-    Token(TokenType t, uint64_t v)
-    : type(t), value(v) {}
+static const NodeIndex NO_PARENT = NO_INDEX;
 
-    TokenType type;
-    uint64_t value;
-};
+// Each node's parent, the lowest numbered one if it has several,
+// NO_PARENT for roots.
+static std::vector<NodeIndex> getParents(const Graph &g) {
+    std::vector<NodeIndex> parents(g.adjList.size(), NO_PARENT);
 
-static std::vector<uint64_t> getSubtreeId(const Graph &g, const std::string &word) {
-    std::vector<std::string> leaves;
+    for (size_t n = 0; n < g.adjList.size(); n++) {
+        for (const NodeIndex &c : g.adjList[n]) {
+            if (parents[c] == NO_PARENT) {
+                parents[c] = n;
+            }
+        }
+    }
 
-    size_t start = 0;
-    size_t end = word.find(',');
+    return parents;
+}
 
-    if (end != std::string::npos) {
-        leaves.push_back(word.substr(start, end - start));
-        start = end + 1;
-    }
+// Finds the node a migration edge's subtree, like (A:0.1,B:0.2), starts
+// at: the lowest common ancestor of its leaves, through binary lifting.
+struct SubtreeIndex {
+public:
+    SubtreeIndex(const Graph &g) {
+        size_t numNodes = g.adjList.size();
 
-    leaves.push_back(word.substr(start));
+        for (const auto &p : g.leafName) {
+            leaves.emplace(p.second, p.first);
+        }
 
-    std::vector<uint64_t> res;
-    res.reserve(leaves.size());
+        std::vector<NodeIndex> parents = getParents(g);
+        depth.assign(numNodes, 0);
 
-    for (const std::string &l : leaves) {
-        start = 0;
-        size_t colon = l.find(':');
+        size_t levels = 1;
+        while ((size_t(1) << levels) < numNodes) {
+            levels++;
+        }
+
+        // Roots are their own ancestors.
+        up.assign(levels, std::vector<NodeIndex>(numNodes));
+        std::vector<NodeIndex> stack;
 
-        if (colon != std::string::npos) {
-            if (l[0] == '(') {
-                start = 1;
+        for (size_t n = 0; n < numNodes; n++) {
+            if (parents[n] == NO_PARENT) {
+                up[0][n] = n;
+                stack.push_back(n);
+            } else {
+                up[0][n] = parents[n];
             }
+        }
+
+        while (!stack.empty()) {
+            NodeIndex n = stack.back();
+            stack.pop_back();
 
-            std::string leafName = l.substr(start, colon - start);
-            for (const auto &p : g.leafName) {
-                if (leafName == p.second) {
-                    res.push_back(p.first);
-                    break;
+            for (const NodeIndex &c : g.adjList[n]) {
+                if (parents[c] == n) {
+                    depth[c] = depth[n] + 1;
+                    stack.push_back(c);
                 }
             }
         }
+
+        for (size_t k = 1; k < levels; k++) {
+            for (size_t n = 0; n < numNodes; n++) {
+                up[k][n] = up[k - 1][up[k - 1][n]];
+            }
+        }
     }
 
-    return res;
-}
+    // Exits if a leaf of the subtree isn't in the tree.
+    NodeIndex find(std::string_view word) const {
+        NodeIndex res = NO_PARENT;
 
-static uint64_t extractSubtree(const Graph &g, const std::string &word) {
-    std::vector<uint64_t> subtreeId = getSubtreeId(g, word);
+        // Leaf names follow a ( or , and end at the first : , ( or )
+        size_t start = 0;
 
-    // Leaf
-    if (subtreeId.size() == 1) {
-        return subtreeId[0];
-    }
+        while (start < word.size()) {
+            size_t end = word.find_first_of(":,()", start);
+
+            if (end == std::string_view::npos) {
+                end = word.size();
+            }
 
-    // Subtree of leaves: (a, b)
-    for (uint64_t i = 0; i < g.adjList.size(); i++) {
-        std::unordered_set<uint64_t> children(g.adjList[i].begin(), g.adjList[i].end());
+            bool isName = end > start && (start == 0 || word[start - 1] == '(' || word[start - 1] == ',');
 
-        bool found = true;
+            if (isName) {
+                auto it = leaves.find(word.substr(start, end - start));
 
-        for (const uint64_t &id : subtreeId) {
-            if (children.find(id) == children.end()) {
-                found = false;
-                break;
+                if (it == leaves.end()) {
+                    std::cerr << "Couldn't find subtree for: " << word << std::endl;
+                    std::exit(EXIT_FAILURE);
+                }
+
+                res = res == NO_PARENT ? it->second : lca(res, it->second);
             }
+
+            start = end + 1;
         }
 
-        if (found) {
-            return i;
+        if (res == NO_PARENT) {
+            std::cerr << "Couldn't find subtree for: " << word << std::endl;
+            std::exit(EXIT_FAILURE);
         }
-    }
 
-    std::cerr << "Couldn't find subtree for: (";
-    std::cerr << g.leafName.at(subtreeId[0]);
-    for (size_t i = 1; i < subtreeId.size(); i++) {
-        std::cerr << ", " << g.leafName.at(subtreeId[i]);
+        return res;
     }
-    std::cerr << ")" << std::endl;
-
-    std::exit(EXIT_FAILURE);
-}
-
-static std::vector<Token> tokenize(std::ifstream &f, const Graph &g) {
-    std::vector<Token> tokens;
 
-    std::string line;
+private:
+    NodeIndex lca(NodeIndex a, NodeIndex b) const {
+        if (depth[a] < depth[b]) {
+            std::swap(a, b);
+        }
 
-    std::getline(f, line);
-    while (std::getline(f, line)) {
-        std::istringstream ss(line);
-        std::string word;
-        std::vector<std::string> words;
-        words.reserve(6);
+        for (size_t k = up.size(); k-- > 0;) {
+            if (depth[a] - depth[b] >= (uint64_t(1) << k)) {
+                a = up[k][a];
+            }
+        }
 
-        while (ss >> word) {
-            words.push_back(word);
+        if (a == b) {
+            return a;
         }
 
-        tokens.emplace_back(
-            TokenType::ORIGIN,
-            extractSubtree(g, words[static_cast<size_t>(TokenType::ORIGIN)])
-        );
+        for (size_t k = up.size(); k-- > 0;) {
+            if (up[k][a] != up[k][b]) {
+                a = up[k][a];
+                b = up[k][b];
+            }
+        }
 
-        tokens.emplace_back(
-            TokenType::DESTINATION,
-            extractSubtree(g, words[static_cast<size_t>(TokenType::DESTINATION)])
-        );
+        return up[0][a];
     }
 
-    return tokens;
-}
+private:
+    std::unordered_map<std::string_view, NodeIndex> leaves;
+    std::vector<NodeIndex> depth;
+    // up[k][n] is the 2^k-th ancestor of n.
+    std::vector<std::vector<NodeIndex>> up;
+};
 
-static bool parse(Graph &g, const std::vector<Token> &tokens) {
-    if (tokens.empty()) {
-        return false;
-    }
+// Puts a new node between the subtree and its parent, and returns it.
+// Returns NO_PARENT, adding a lone node, if the subtree is the root.
+static NodeIndex insertAbove(Graph &g, std::vector<NodeIndex> &parents, NodeIndex subtree) {
+    NodeIndex newNode = g.adjList.size();
+    g.addNode();
+    parents.push_back(NO_PARENT);
 
-    uint64_t origin = 0;
+    NodeIndex parent = parents[subtree];
 
-    for (const Token &t : tokens) {
-        uint64_t subtree = t.value;
+    if (parent == NO_PARENT) {
+        return NO_PARENT;
+    }
 
-        uint64_t newNode = g.adjList.size();
-        g.addNode();
+    std::vector<NodeIndex> &children = g.adjList[parent];
+    *std::find(children.begin(), children.end(), subtree) = newNode;
 
-        for (size_t i = 0; i < g.adjList.size(); i++) {
-            std::vector<uint64_t> &children = g.adjList[i];
-            auto it = std::find(children.begin(), children.end(), subtree);
+    parents[newNode] = parent;
+    parents[subtree] = newNode;
 
-            if (it != children.end()) {
-                if (t.type == TokenType::ORIGIN) {
-                    *it = newNode;
-                    origin = newNode;
-                    g.addEdge(newNode, subtree);
-                } else {
-                    *it = newNode;
-                    g.addEdge(newNode, subtree);
-                    g.addEdge(origin, newNode);
+    g.addEdge(newNode, subtree);
 
-                    g.reticulations[newNode].push_back(origin);
-                    g.reticulations[newNode].push_back(i);
-                }
+    return newNode;
+}
 
-                break;
-            }
-        }
+bool isTreemix(std::string_view data) {
+    std::string_view head = sniffHead(data);
+
+    if (head.empty() || head[0] != '(') {
+        return false;
     }
 
-    return true;
-}
+    // The tree can be longer than the head, so this looks past it for
+    // what follows the tree: migration edges, not another network.
+    size_t end = data.find(';');
 
-bool openTreemix(Graph &g, const std::string &file) {
-    if (!openENWK(g, file)) {
+    if (end == std::string_view::npos) {
         return false;
     }
 
-    std::ifstream f(file);
+    size_t next = data.find_first_not_of(" \t\r\n", end + 1);
 
-    if (!f.is_open()) {
+    return next != std::string_view::npos && data[next] != '(';
+}
+
+bool openTreemix(Graph &g, std::string_view data) {
+    if (!readENWK(g, data)) {
         return false;
     }
 
-    std::vector<Token> tokens = tokenize(f, g);
-    f.close();
+    // The subtrees are looked up in the tree as it was read, while
+    // the migrations are added as their lines go by.
+    SubtreeIndex index(g);
+    std::vector<NodeIndex> parents = getParents(g);
+
+    std::string_view line;
+    std::string_view fields[NUM_FIELDS];
+    NodeIndex origin = 0;
+    bool anyMigrations = false;
+
+    // Whatever follows the tree on its line.
+    nextLine(data, line);
+
+    while (nextLine(data, line)) {
+        if (splitFields(line, fields, NUM_FIELDS) < NUM_FIELDS) {
+            continue;
+        }
+
+        NodeIndex originSubtree = index.find(fields[ORIGIN_FIELD]);
+        NodeIndex destinationSubtree = index.find(fields[DESTINATION_FIELD]);
+        anyMigrations = true;
+
+        NodeIndex newOrigin = insertAbove(g, parents, originSubtree);
+
+        if (newOrigin != NO_PARENT) {
+            origin = newOrigin;
+        }
+
+        NodeIndex destination = insertAbove(g, parents, destinationSubtree);
+
+        if (destination != NO_PARENT) {
+            g.addEdge(origin, destination);
+
+            g.reticulations[destination].push_back(origin);
+            g.reticulations[destination].push_back(parents[destination]);
+        }
+    }
 
-    return parse(g, tokens);
+    return anyMigrations;
 }
 
 void saveTreemix(const Graph &g, const std::string &filename) {
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 #include "../graph.h"
 
-bool openTreemix(Graph &g, const std::string &file);
+bool isTreemix(std::string_view data);
+bool openTreemix(Graph &g, std::string_view data);
 void saveTreemix(const Graph &g, const std::string &filename);
@@ -4,19 +4,54 @@
 #include <cstdint>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "formats/format.h"
+#include "formats/inputFile.h"
+#include "taxa.h"
+
+NodeOrders &NodeOrders::operator=(const NodeOrders &) {
+    clear();
+    return *this;
+}
+
+void NodeOrders::clear() {
+    std::lock_guard<std::mutex> guard(lock);
+
+    ready = false;
+    pre.clear();
+    post.clear();
+    topological.clear();
+}
 
 void Graph::addNode() {
     adjList.emplace_back();
 }
 
-unsigned int Graph::getNumNodes() const {
+static NodeIndex getRoot(const std::vector<NodeIndex> &parentOffsets) {
+    for (size_t n = 0; n + 1 < parentOffsets.size(); n++) {
+        if (parentOffsets[n] == parentOffsets[n + 1]) {
+            return n;
+        }
+    }
+
+    std::cerr << "Couldn't find root." << std::endl;
+    std::exit(EXIT_FAILURE);
+}
+
+size_t Graph::getNumNodes() const {
+    if (!childOffsets.empty()) {
+        return childOffsets.size() - 1;
+    }
+
     return adjList.size();
 }
 
-void Graph::addEdge(uint64_t source, uint64_t target) {
+void Graph::addEdge(NodeIndex source, NodeIndex target) {
     if (source >= adjList.size()) {
         addNode();
     }
@@ -24,8 +59,12 @@ void Graph::addEdge(uint64_t source, uint64_t target) {
     adjList[source].push_back(target);
 }
 
-unsigned int Graph::getNumEdges() const {
-    unsigned int total = 0;
+size_t Graph::getNumEdges() const {
+    if (!childOffsets.empty()) {
+        return childTargets.size();
+    }
+
+    size_t total = 0;
 
     for (const auto &e : adjList) {
         total += e.size();
@@ -34,26 +73,195 @@ unsigned int Graph::getNumEdges() const {
     return total;
 }
 
-static uint64_t getRoot(const std::vector<std::vector<uint64_t>> &adjList) {
-    std::vector<uint64_t> inDegree(adjList.size());
+void Graph::freeze() {
+    if (adjList.empty() && !childOffsets.empty()) {
+        return;
+    }
+
+    size_t numNodes = adjList.size();
+    size_t numEdges = 0;
 
-    for (const auto &n : adjList) {
-        for (const auto &t : n) {
-            inDegree[t]++;
+    for (const auto &e : adjList) {
+        numEdges += e.size();
+    }
+
+    // NO_INDEX has to stay free, and an offset can be numEdges.
+    if (numNodes >= NO_INDEX || numEdges >= NO_INDEX) {
+        std::cerr << "The graph has too many nodes or edges for this build, rebuild with make WIDE_INDEX=1." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    childOffsets.assign(numNodes + 1, 0);
+    parentOffsets.assign(numNodes + 1, 0);
+
+    for (size_t n = 0; n < numNodes; n++) {
+        childOffsets[n + 1] = childOffsets[n] + adjList[n].size();
+
+        for (const NodeIndex &t : adjList[n]) {
+            parentOffsets[t + 1]++;
         }
     }
 
-    auto it = std::find(inDegree.begin(), inDegree.end(), 0);
+    for (size_t n = 0; n < numNodes; n++) {
+        parentOffsets[n + 1] += parentOffsets[n];
+    }
 
-    if (it == inDegree.end()) {
-        std::cerr << "Couldn't find root." << std::endl;
-        std::exit(EXIT_FAILURE);
+    childTargets.clear();
+    childTargets.reserve(childOffsets[numNodes]);
+    parentTargets.assign(parentOffsets[numNodes], 0);
+
+    std::vector<NodeIndex> parentPos(parentOffsets.begin(), parentOffsets.end() - 1);
+
+    for (size_t n = 0; n < numNodes; n++) {
+        for (const NodeIndex &t : adjList[n]) {
+            childTargets.push_back(t);
+            parentTargets[parentPos[t]++] = n;
+        }
+    }
+
+    // Some parsers can push the same leaf more than once.
+    std::vector<NodeIndex> leafNodes = std::move(leaves);
+    std::vector<char> seen(numNodes, false);
+    leaves.clear();
+    leafNames.clear();
+
+    for (const NodeIndex &l : leafNodes) {
+        if (seen[l]) {
+            continue;
+        }
+
+        seen[l] = true;
+        leaves.push_back(l);
+        leafNames.push_back(std::move(leafName[l]));
+    }
+
+    reticulationNodes.clear();
+    reticulationNodes.reserve(reticulations.size());
+
+    for (const auto &p : reticulations) {
+        reticulationNodes.push_back(p.first);
+    }
+
+    std::sort(reticulationNodes.begin(), reticulationNodes.end());
+
+    root = getRoot(parentOffsets);
+
+    std::vector<std::vector<NodeIndex>>().swap(adjList);
+    std::unordered_map<NodeIndex, std::string>().swap(leafName);
+    std::unordered_map<NodeIndex, std::vector<NodeIndex>>().swap(reticulations);
+
+    buildIndex();
+}
+
+void Graph::buildIndex() {
+    size_t numNodes = getNumNodes();
+
+    orders.clear();
+
+    leafIndex.assign(numNodes, NO_LEAF);
+
+    for (size_t i = 0; i < leaves.size(); i++) {
+        leafIndex[leaves[i]] = i;
     }
 
-    return std::distance(inDegree.begin(), it);
+    taxa.getIds(leafNames, leafTaxa);
+
+    reticulationBits.assign((numNodes + 63) / 64, 0);
+
+    for (const NodeIndex &r : reticulationNodes) {
+        reticulationBits[r >> 6] |= uint64_t(1) << (r & 63);
+    }
 }
 
-static std::string filenameNoExt(const std::string &file) {
+NodeSpan Graph::children(NodeIndex node) const {
+    const NodeIndex *base = childTargets.data();
+    return {base + childOffsets[node], base + childOffsets[node + 1]};
+}
+
+NodeSpan Graph::parents(NodeIndex node) const {
+    const NodeIndex *base = parentTargets.data();
+    return {base + parentOffsets[node], base + parentOffsets[node + 1]};
+}
+
+bool Graph::isLeaf(NodeIndex node) const {
+    return leafIndex[node] != NO_LEAF;
+}
+
+bool Graph::isReticulation(NodeIndex node) const {
+    return (reticulationBits[node >> 6] >> (node & 63)) & 1;
+}
+
+const std::string &Graph::getLeafName(NodeIndex node) const {
+    return leafNames[leafIndex[node]];
+}
+
+NodeIndex Graph::getTaxon(NodeIndex node) const {
+    return leafTaxa[leafIndex[node]];
+}
+
+size_t Graph::getNumReticulations() const {
+    return reticulationNodes.size();
+}
+
+// Fills in all three orders in a single walk.
+static void depthFirstOrders(const Graph &g, NodeOrders &orders) {
+    size_t numNodes = g.getNumNodes();
+    std::vector<char> visited(numNodes, false);
+
+    orders.pre.reserve(numNodes);
+    orders.post.reserve(numNodes);
+
+    auto follow = [](NodeIndex, NodeIndex) { return true; };
+
+    auto enter = [&](NodeIndex node, NodeIndex, size_t) {
+        if (visited[node]) {
+            return false;
+        }
+
+        visited[node] = true;
+        orders.pre.push_back(node);
+
+        return true;
+    };
+
+    auto leave = [&](NodeIndex node, NodeIndex) {
+        orders.post.push_back(node);
+    };
+
+    for (size_t n = 0; n < numNodes; n++) {
+        if (g.parents(n).empty()) {
+            g.walk(n, follow, enter, leave);
+        }
+    }
+
+    orders.topological.assign(orders.post.rbegin(), orders.post.rend());
+}
+
+static const NodeOrders &getOrders(const Graph &g) {
+    std::lock_guard<std::mutex> guard(g.orders.lock);
+
+    if (!g.orders.ready) {
+        depthFirstOrders(g, g.orders);
+        g.orders.ready = true;
+    }
+
+    return g.orders;
+}
+
+const std::vector<NodeIndex> &Graph::preorder() const {
+    return getOrders(*this).pre;
+}
+
+const std::vector<NodeIndex> &Graph::postorder() const {
+    return getOrders(*this).post;
+}
+
+const std::vector<NodeIndex> &Graph::topologicalOrder() const {
+    return getOrders(*this).topological;
+}
+
+static std::string filenameNoExt(const std::string &compressedFile) {
+    std::string file = withoutCompressionExt(compressedFile);
     size_t dotPos = file.find_last_of(".");
 
     if (dotPos == std::string::npos) {
@@ -69,7 +277,8 @@ static std::string filenameNoExt(const std::string &file) {
     }
 }
 
-static std::string getExtension(const std::string &filename) {
+static std::string getExtension(const std::string &compressedFile) {
+    std::string filename = withoutCompressionExt(compressedFile);
     size_t pos = filename.find_last_of('.');
     
     if (pos == std::string::npos) {
@@ -83,35 +292,50 @@ void Graph::open(const std::string &file) {
     std::string ext = getExtension(file);
     filename = file;
 
+    InputFile data;
+
+    if (!data.open(file)) {
+        std::cerr << "Failed to open `" << file << "`" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    const Format *match = nullptr;
+
     // Go through each format and their expected extension name(s).
     for (const Format &f : formats) {
         for (const std::string &e : f.exts) {
-            if (ext == e) {
-                if (!f.open(*this, file)) {
-                    std::cerr << "Failed to open `" << file << "`" << std::endl;
-                    std::exit(EXIT_FAILURE);
-                }
-
-                format = f.type;
-                root = getRoot(adjList);
-                return;
+            if (!e.empty() && ext == e) {
+                match = &f;
             }
         }
     }
 
-    // If the file didn't have a valid file extension
-    // Try to open it by bruteforcing it with every format
-    for (const auto &f : formats) {
-        if (f.open(*this, file)) {
-            format = f.type;
-            root = getRoot(adjList);
-            return;
+    // If the file didn't have a valid file extension,
+    // tell the format from the start of the file instead.
+    if (match == nullptr) {
+        for (FormatType t : sniffOrder) {
+            const Format &f = formats[static_cast<size_t>(t)];
+
+            if (f.sniff(data.data())) {
+                match = &f;
+                break;
+            }
         }
     }
 
-    std::cerr << "Couldn't open '" << file << "'" << std::endl;
-    printFormats();
-    std::exit(EXIT_FAILURE);
+    if (match == nullptr) {
+        std::cerr << "Couldn't open '" << file << "'" << std::endl;
+        printFormats();
+        std::exit(EXIT_FAILURE);
+    }
+
+    if (!match->open(*this, data.data())) {
+        std::cerr << "Failed to open `" << file << "`" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    format = match->type;
+    freeze();
 }
 
 void Graph::save(FormatType f, const std::string &filename) const {
@@ -121,17 +345,17 @@ void Graph::save(FormatType f, const std::string &filename) const {
 }
 
 void Graph::print() const {
-    for (size_t i = 0; i < adjList.size(); i++) {
+    for (size_t i = 0; i < getNumNodes(); i++) {
         std::cout << i;
 
-        if (reticulations.find(i) != reticulations.end()) {
+        if (isReticulation(i)) {
             std::cout << "r";
         } else {
             std::cout << " ";
         }
 
         std::cout << ": [";
-        for (const auto &t : adjList[i]) {
+        for (const auto &t : children(i)) {
             std::cout << t << ", ";
         }
         std::cout << "]" << std::endl;
@@ -139,21 +363,21 @@ void Graph::print() const {
     std::cout << std::endl;
 
     std::cout << "Reticulations: [";
-    for (const auto &p : reticulations) {
-        std::cout << p.first << ", ";
+    for (const auto &r : reticulationNodes) {
+        std::cout << r << ", ";
     }
     std::cout << "]" << std::endl;
 
     std::cout << "Leaf nodes: [" << std::endl;
-    for (const auto &p : leafName) {
-        std::cout << "    " << p.first << ": " << p.second << "," << std::endl;
+    for (size_t i = 0; i < leaves.size(); i++) {
+        std::cout << "    " << leaves[i] << ": " << leafNames[i] << "," << std::endl;
     }
     std::cout << "]" << std::endl;
 
     std::cout << std::endl;
 
     std::cout << "NumLeaves: " << leaves.size() << std::endl;
-    std::cout << "NumReticulations: " << reticulations.size() << std::endl;
+    std::cout << "NumReticulations: " << getNumReticulations() << std::endl;
     std::cout << "NumNodes: " << getNumNodes() << std::endl;
     std::cout << "NumEdges: " << getNumEdges() << std::endl;
 }
@@ -1,19 +1,120 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "formats/formatType.h"
+#include "nodeIndex.h"
+
+// leafIndex value of a node that isn't a leaf.
+const NodeIndex NO_LEAF = NO_INDEX;
+
+// The parent walk passes for the node it starts at.
+const NodeIndex NO_NODE = NO_INDEX;
+
+// A read-only view over a contiguous run of node indices,
+// such as the children or parents of a node.
+struct NodeSpan {
+public:
+    const NodeIndex *begin() const { return first; }
+    const NodeIndex *end() const { return last; }
+
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+
+    NodeIndex operator[](size_t i) const { return first[i]; }
+
+public:
+    const NodeIndex *first;
+    const NodeIndex *last;
+};
+
+// A node being walked, the next of its child edges to look at
+// and the end of them.
+struct WalkFrame {
+    NodeIndex node;
+    NodeIndex edge;
+    NodeIndex end;
+};
+
+// The stack of a Graph::walk. Callers that walk often can keep one
+// around, so it isn't allocated and grown again every time.
+using WalkStack = std::vector<WalkFrame>;
+
+// The node orders of a Graph, worked out the first time one of them is
+// asked for. Compare reads the same graph from several threads, so
+// they're filled in under a lock. A copy starts out empty, since it's
+// usually a graph about to be changed or replaced.
+struct NodeOrders {
+public:
+    NodeOrders() = default;
+    NodeOrders(const NodeOrders &) {}
+    NodeOrders &operator=(const NodeOrders &);
+
+    void clear();
+
+public:
+    std::mutex lock;
+    bool ready = false;
+
+    std::vector<NodeIndex> pre;
+    std::vector<NodeIndex> post;
+    std::vector<NodeIndex> topological;
+};
 
 struct Graph {
 public:
     void addNode();
-    unsigned int getNumNodes() const;
+    size_t getNumNodes() const;
+
+    void addEdge(NodeIndex source, NodeIndex target);
+    size_t getNumEdges() const;
+
+    // Packs what the parsers built (adjList, leafName, reticulations)
+    // into the flat arrays below, then releases the former.
+    // Does nothing if the flat arrays were loaded directly.
+    void freeze();
+
+    // Fills in leafIndex, leafTaxa and reticulationBits
+    // from leaves, leafNames and reticulationNodes.
+    void buildIndex();
+
+    NodeSpan children(NodeIndex node) const;
+    NodeSpan parents(NodeIndex node) const;
 
-    void addEdge(uint64_t source, uint64_t target);
-    unsigned int getNumEdges() const;
+    bool isLeaf(NodeIndex node) const;
+    bool isReticulation(NodeIndex node) const;
+    const std::string &getLeafName(NodeIndex node) const;
+    // The leaf's id in the taxon dictionary.
+    NodeIndex getTaxon(NodeIndex node) const;
+    size_t getNumReticulations() const;
+
+    // Depth first walk down from start, on an explicit stack so deep
+    // networks can't overflow the call stack. Like a recursive walk, a
+    // node is visited once for every path to it through followed edges.
+    //
+    // follow(parent, child) picks the edges to go down.
+    // enter(node, parent, nth) is called on the way down, nth being the
+    // node's position in the parent's children, and returns whether to
+    // go into the node's children.
+    // leave(node, parent) is called once they're all done, only for the
+    // nodes enter went into.
+    template <typename Follow, typename Enter, typename Leave>
+    void walk(NodeIndex start, Follow follow, Enter enter, Leave leave) const;
+    template <typename Follow, typename Enter, typename Leave>
+    void walk(NodeIndex start, Follow follow, Enter enter, Leave leave, WalkStack &stack) const;
+
+    // Every node once, from the nodes without parents down, the root
+    // first. In pre order a node comes before everything under it, in
+    // post order after, and the topological order is post order reversed.
+    // They're computed at most once, until the graph changes.
+    const std::vector<NodeIndex> &preorder() const;
+    const std::vector<NodeIndex> &postorder() const;
+    const std::vector<NodeIndex> &topologicalOrder() const;
 
     void open(const std::string &file);
     void save(FormatType f, const std::string &filename) const;
@@ -21,14 +122,104 @@ public:
     void print() const;
 
 public:
-    std::vector<std::vector<uint64_t>> adjList;
-    std::vector<uint64_t> leaves;
-    std::unordered_map<uint64_t, std::string> leafName;
-    uint64_t root;
-
+    // Only used while parsing, empty once the graph is frozen.
+    std::vector<std::vector<NodeIndex>> adjList;
+    std::unordered_map<NodeIndex, std::string> leafName;
     // The vec contains the reticulation's parents
-    std::unordered_map<uint64_t, std::vector<uint64_t>> reticulations;
+    std::unordered_map<NodeIndex, std::vector<NodeIndex>> reticulations;
+
+    // CSR: the children of node n are
+    // childTargets[childOffsets[n]] .. childTargets[childOffsets[n + 1] - 1],
+    // and likewise for the parents.
+    std::vector<NodeIndex> childOffsets;
+    std::vector<NodeIndex> childTargets;
+    std::vector<NodeIndex> parentOffsets;
+    std::vector<NodeIndex> parentTargets;
+
+    // leaves[i] is the node of the i-th leaf, leafNames[i] its name,
+    // leafTaxa[i] the name's taxon id and leafIndex[leaves[i]] == i.
+    std::vector<NodeIndex> leaves;
+    std::vector<std::string> leafNames;
+    std::vector<NodeIndex> leafTaxa;
+    std::vector<NodeIndex> leafIndex;
+
+    // Per edge, in childTargets order, NaN where the file had none.
+    // Only the formats that carry them fill these in, else they're empty.
+    std::vector<float> edgeWeights;
+    std::vector<float> admixProportions;
+
+    // One bit per node, set if the node is a reticulation.
+    std::vector<uint64_t> reticulationBits;
+    std::vector<NodeIndex> reticulationNodes;
+
+    NodeIndex root;
 
     FormatType format;
     std::string filename;
+
+    // Cleared by buildIndex, which every change to the graph ends with.
+    mutable NodeOrders orders;
 };
+
+template <typename Follow, typename Enter, typename Leave>
+void Graph::walk(NodeIndex start, Follow follow, Enter enter, Leave leave) const {
+    WalkStack stack;
+    walk(start, follow, enter, leave, stack);
+}
+
+template <typename Follow, typename Enter, typename Leave>
+void Graph::walk(NodeIndex start, Follow follow, Enter enter, Leave leave, WalkStack &stack) const {
+    if (!enter(start, NO_NODE, 0)) {
+        return;
+    }
+
+    // The frames are used through a pointer to the top, and the stack
+    // only grows when a path gets deeper than it's ever been.
+    if (stack.empty()) {
+        stack.resize(64);
+    }
+
+    WalkFrame *bottom = stack.data();
+    WalkFrame *top = bottom;
+    *top = {start, childOffsets[start], childOffsets[start + 1]};
+
+    while (true) {
+        NodeIndex node = top->node;
+        NodeIndex edge = top->edge;
+        NodeIndex end = top->end;
+
+        // Goes through the node's children until one is entered.
+        for (; edge != end; edge++) {
+            NodeIndex child = childTargets[edge];
+
+            if (follow(node, child) && enter(child, node, edge - childOffsets[node])) {
+                break;
+            }
+        }
+
+        if (edge == end) {
+            if (top == bottom) {
+                leave(node, NO_NODE);
+                break;
+            }
+
+            top--;
+            leave(node, top->node);
+
+            continue;
+        }
+
+        top->edge = edge + 1;
+
+        if (top + 1 == bottom + stack.size()) {
+            size_t depth = top - bottom;
+            stack.resize(stack.size() * 2);
+
+            bottom = stack.data();
+            top = bottom + depth;
+        }
+
+        NodeIndex child = childTargets[edge];
+        *++top = {child, childOffsets[child], childOffsets[child + 1]};
+    }
+}
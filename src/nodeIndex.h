@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+// The type of node, edge, leaf and taxon indices, from the graph through
+// the PSWs and cluster tables. It's 32 bits, which halves the memory of
+// all of them, unless the build defines WIDE_NODE_INDEX for graphs with
+// more than 4 billion nodes or edges (make WIDE_INDEX=1).
+#ifdef WIDE_NODE_INDEX
+using NodeIndex = uint64_t;
+#else
+using NodeIndex = uint32_t;
+#endif
+
+// The largest index, which is never a valid one, so it can mark a
+// missing node, leaf or block.
+const NodeIndex NO_INDEX = ~NodeIndex(0);
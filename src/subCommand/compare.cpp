@@ -4,13 +4,17 @@
 #include <cstring>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <utility>
 
+#include "../formats/eNewick.h"
 #include "../formats/format.h"
-// #include "compare/jaccardIndex.h"
+#include "compare/compareOptions.h"
+#include "compare/jaccardIndex.h"
 #include "compare/precisionAndRecall.h"
 #include "compare/robinsonFoulds.h"
 
-typedef void (*compareFunc)(const Graph &, const Graph &);
+typedef void (*compareFunc)(const Graph &, const Graph &, const CompareOptions &);
 
 struct CompareMethod {
     std::string name;
@@ -19,7 +23,7 @@ struct CompareMethod {
 
 static CompareMethod compareMethods[] = {
     {"rf", robinsonFoulds},
-    // {"ji", jaccardIndex},
+    {"ji", jaccardIndex},
     {"pr", precisionAndRecall},
 };
 
@@ -28,19 +32,60 @@ static void compareUsage() {
     std::cout << "Compares one graph to another using a specified method." << std::endl;
     std::cout << std::endl;
     std::cout << "USAGE:" << std::endl;
-    std::cout << "\tPhyloGraphUtil compare <METHOD> <INPUT1> <INPUT2>" << std::endl;
+    std::cout << "\tPhyloGraphUtil compare [-j <N>] [-i] [-m] <METHOD> <INPUT1> <INPUT2>" << std::endl;
     std::cout << std::endl;
     std::cout << "FLAGS:" << std::endl;
     std::cout << "\t-h\tPrints help information." << std::endl;
+    std::cout << "\t-j, --threads <N>" << std::endl;
+    std::cout << "\t\tRF only. Number of threads to use. Defaults to the number of cores." << std::endl;
+    std::cout << "\t-i, --index" << std::endl;
+    std::cout << "\t\tRF only. Finds the clusters shared by each pair of display trees through" << std::endl;
+    std::cout << "\t\tan index of INPUT1's clusters. Faster when the display trees share most" << std::endl;
+    std::cout << "\t\tof their clusters, but keeps every cluster of INPUT1 in memory." << std::endl;
+    std::cout << "\t-m, --multi" << std::endl;
+    std::cout << "\t\tINPUT2 is an eNewick file holding many networks, one after another." << std::endl;
+    std::cout << "\t\tEach one is compared to INPUT1 as it's read, without loading the rest." << std::endl;
     std::cout << std::endl;
     std::cout << "METHOD:" << std::endl;
     std::cout << "\trf\tRobinson Foulds." << std::endl;
-    // std::cout << "\tji\tJaccard index." << std::endl;
+    std::cout << "\tji\tJaccard index." << std::endl;
     std::cout << "\tpr\tPrecision & Recall. (INPUT1 is original, INPUT2 will be compared to INPUT1" << std::endl;
     std::cout << std::endl;
     printFormats();
 }
 
+// Compares every network of the file with g, reading the next network
+// on another thread while the current one is being compared.
+static void compareEach(compareFunc cf, const Graph &g, const std::string &file,
+                        const CompareOptions &opts) {
+    ENWKStream s;
+
+    if (!s.open(file)) {
+        std::cerr << "Failed to open `" << file << "`" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    Graph cur;
+    Graph next;
+    bool hasNext = s.next(cur);
+
+    while (hasNext) {
+        std::thread reader([&] { hasNext = s.next(next); });
+
+        std::cout << "'" << cur.filename << "':" << std::endl;
+        cf(g, cur, opts);
+        std::cout << std::endl;
+
+        reader.join();
+        std::swap(cur, next);
+    }
+
+    if (s.failed()) {
+        std::cerr << "Failed to read network " << s.numRead() << " of `" << file << "`" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+}
+
 void compare(int argc, char **argv) {
     if (argc == 0) {
         compareUsage();
@@ -48,6 +93,9 @@ void compare(int argc, char **argv) {
     }
 
     compareFunc cf = nullptr;
+    CompareOptions opts = {std::thread::hardware_concurrency(), false};
+    bool multi = false;
+    std::string multiFile;
     Graph g1 = {.format = FormatType::INVALID};
     Graph g2 = {.format = FormatType::INVALID};
 
@@ -57,6 +105,31 @@ void compare(int argc, char **argv) {
             std::exit(EXIT_SUCCESS);
         }
 
+        if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--threads")) {
+            char *end = nullptr;
+            long n = i + 1 < argc ? std::strtol(argv[i + 1], &end, 10) : 0;
+
+            if (end == nullptr || *end != '\0' || n <= 0) {
+                std::cout << "'" << argv[i] << "' expects a positive number of threads" << std::endl;
+                compareUsage();
+                std::exit(EXIT_FAILURE);
+            }
+
+            opts.numThreads = n;
+            i++;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-i") || !strcmp(argv[i], "--index")) {
+            opts.clusterIndex = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-m") || !strcmp(argv[i], "--multi")) {
+            multi = true;
+            continue;
+        }
+
         if (cf == nullptr) {
             for (const CompareMethod &cm : compareMethods) {
                 if (argv[i] == cm.name) {
@@ -72,17 +145,28 @@ void compare(int argc, char **argv) {
             }
         } else if (g1.format == FormatType::INVALID) {
             g1.open(argv[i]);
-        } else if (g2.format == FormatType::INVALID) {
+        } else if (multi && multiFile.empty()) {
+            multiFile = argv[i];
+        } else if (!multi && g2.format == FormatType::INVALID) {
             g2.open(argv[i]);
         }
     }
 
     if (cf == nullptr
     ||  g1.format == FormatType::INVALID
-    ||  g2.format == FormatType::INVALID) {
+    ||  (multi ? multiFile.empty() : g2.format == FormatType::INVALID)) {
         compareUsage();
         std::exit(EXIT_FAILURE);
     }
 
-    cf(g1, g2);
+    if (opts.numThreads == 0) {
+        opts.numThreads = 1;
+    }
+
+    if (multi) {
+        compareEach(cf, g1, multiFile, opts);
+        return;
+    }
+
+    cf(g1, g2, opts);
 }
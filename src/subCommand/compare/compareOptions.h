@@ -0,0 +1,12 @@
+#pragma once
+
+// Settings shared by every comparison method, filled in from the
+// flags given to `compare`.
+struct CompareOptions {
+    // Number of worker threads, at least 1.
+    unsigned int numThreads;
+
+    // RF: count shared clusters through an inverted index of the first
+    // graph's clusters instead of running COMCLUST on every pair.
+    bool clusterIndex;
+};
@@ -1,79 +1,45 @@
 #include "jaccardIndex.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <vector>
 
-#include "util/clusterTable.h"
-#include "util/psw.h"
+#include "util/clusterIndex.h"
 
-using ClusterSet = std::unordered_map<uint64_t, std::unordered_set<uint64_t>>;
-
-static ClusterSet extractClusters(const Graph &g, const std::vector<PSW> &psws) {
-    ClusterSet res;
-
-    for (const PSW &psw : psws) {
-        ClusterTable ct(g, psw);
-
-        for (const auto &l : ct.ct) {
-            res[l.first].insert(l.second.begin(), l.second.end());
-        }
-    }
-
-    return res;
-}
-
-void jaccardIndex(const Graph &g1, const Graph &g2) {
+void jaccardIndex(const Graph &g1, const Graph &g2, const CompareOptions &) {
     if (g1.leaves.size() != g2.leaves.size()) {
         std::cerr << "Trees do not have the same number of leaves." << std::endl;
         std::exit(EXIT_FAILURE);
     }
 
-    std::unordered_set<std::string> leaves1;
-    for (const auto &p : g1.leafName) {
-        leaves1.insert(p.second);
-    }
+    std::vector<NodeIndex> taxa1(g1.leafTaxa);
+    std::sort(taxa1.begin(), taxa1.end());
 
-    std::unordered_set<std::string> leaves2;
-    for (const auto &p : g2.leafName) {
-        leaves2.insert(p.second);
-    }
+    std::vector<NodeIndex> taxa2(g2.leafTaxa);
+    std::sort(taxa2.begin(), taxa2.end());
 
-    if (leaves1 != leaves2) {
+    if (taxa1 != taxa2) {
         std::cerr << "Trees do not have the same leaf names." << std::endl;
         std::exit(EXIT_FAILURE);
     }
 
-    std::vector<PSW> psws1 = genPSWs(g1);
-    std::vector<PSW> psws2 = genPSWs(g2);
-
-    ClusterSet c1 = extractClusters(g1, psws1);
-    ClusterSet c2 = extractClusters(g2, psws2);
+    ClusterSet c1 = displayedClusters(g1);
+    ClusterSet c2 = displayedClusters(g2);
 
     double intersection = 0.0;
 
-    for (const auto &p : c1) {
-        if (c2.find(p.first) == c2.end()) {
-            continue;
-        }
-
-        for (const auto &e : p.second) {
-            if (c2[p.first].find(e) != c2[p.first].end()) {
-                intersection++;
-            }
+    for (const ClusterKey &k : c1) {
+        if (c2.find(k) != c2.end()) {
+            intersection++;
         }
     }
 
-    // Union
-    for (const auto &p : c2) {
-        c1[p.first].insert(p.second.begin(), p.second.end());
-    }
-
-    double unionSize = 0.0;
-
-    for (const auto &p : c1) {
-        unionSize += p.second.size();
-    }
+    double unionSize = c1.size() + c2.size() - intersection;
 
-    double similarity = intersection / unionSize;
+    // Neither has a non-trivial cluster, so there's nothing to tell them apart.
+    double similarity = unionSize == 0.0 ? 1.0 : intersection / unionSize;
     double diff = 1 - similarity;
     double percentage = diff * 100.0;
 
@@ -4,7 +4,6 @@
 #include <cstdint>
 #include <iostream>
 #include <limits>
-#include <queue>
 #include <utility>
 #include <vector>
 
@@ -27,72 +26,28 @@
 //     return std::distance(inDegree.begin(), it);
 // }
 
-static std::vector<uint64_t> topologicalSort(const std::vector<std::vector<uint64_t>> &adjList) {
-    std::vector<uint64_t> inDegree(adjList.size(), 0);
-
-    // Calculate in-degrees
-    for (uint64_t u = 0; u < adjList.size(); u++) {
-        for (uint64_t v : adjList[u]) {
-            inDegree[v]++;
-        }
-    }
-
-    // Initialize queue with roots (nodes with in-degree 0)
-    std::queue<uint64_t> q;
-    for (size_t i = 0; i < adjList.size(); i++) {
-        if (inDegree[i] == 0) {
-            q.push(i);
-        }
-    }
-
-    std::vector<uint64_t> res;
-
-    while (!q.empty()) {
-        uint64_t vertex = q.front();
-        q.pop();
-
-        res.push_back(vertex);
-
-        for (uint64_t neighbor : adjList[vertex]) {
-            inDegree[neighbor]--;
-            if (inDegree[neighbor] == 0) {
-                q.push(neighbor);
-            }
-        }
-    }
-
-    return res;
-}
-
 static std::vector<std::pair<uint64_t, uint64_t>> pathVectorsHelper(const Graph &g) {
     const uint64_t INF = std::numeric_limits<uint64_t>::max();
-    std::vector<uint64_t> shortestPaths(g.adjList.size(), INF);
-    std::vector<uint64_t> longestPaths(g.adjList.size(), 0);
-
-    std::vector<uint64_t> topoOrder = topologicalSort(g.adjList);
+    std::vector<uint64_t> shortestPaths(g.getNumNodes(), INF);
+    std::vector<uint64_t> longestPaths(g.getNumNodes(), 0);
 
-    std::vector<bool> hasIncomingEdge(g.adjList.size(), false);
-    for (uint64_t u = 0; u < g.adjList.size(); u++) {
-        for (uint64_t v : g.adjList[u]) {
-            hasIncomingEdge[v] = true;
-        }
-    }
+    const std::vector<NodeIndex> &topoOrder = g.topologicalOrder();
 
     // Make root node have a distance 0
-    for (uint64_t i = 0; i < g.adjList.size(); i++) {
-        if (!hasIncomingEdge[i]) {
+    for (NodeIndex i = 0; i < g.getNumNodes(); i++) {
+        if (g.parents(i).empty()) {
             shortestPaths[i] = 0;
             longestPaths[i] = 0;
         }
     }
 
-    for (uint64_t n : topoOrder) {
+    for (NodeIndex n : topoOrder) {
         // Continue if we haven't reached this non-root node yet
         if (shortestPaths[n] == INF) {
             continue;
         }
 
-        for (uint64_t child : g.adjList[n]) {
+        for (NodeIndex child : g.children(n)) {
             shortestPaths[child] = std::min(shortestPaths[child], shortestPaths[n] + 1);
             longestPaths[child] = std::max(longestPaths[child], longestPaths[n] + 1);
         }
@@ -100,7 +55,7 @@ static std::vector<std::pair<uint64_t, uint64_t>> pathVectorsHelper(const Graph
 
     std::vector<std::pair<uint64_t, uint64_t>> res;
 
-    for (uint64_t l : g.leaves) {
+    for (NodeIndex l : g.leaves) {
         res.push_back({shortestPaths[l], longestPaths[l]});
     }
 
@@ -111,8 +66,8 @@ void findPathVectors(const Graph &g1, const Graph &g2) {
     auto x1 = pathVectorsHelper(g1);
 
     size_t i = 0;
-    for (uint64_t l : g1.leaves) {
-        std::cout << g1.leafName.at(l) << " ";
+    for (NodeIndex l : g1.leaves) {
+        std::cout << g1.getLeafName(l) << " ";
         std::cout << "Shortest: " << x1[i].first << ", ";
         std::cout << "Longest: " << x1[i].second << std::endl;
         i++;
@@ -120,8 +75,8 @@ void findPathVectors(const Graph &g1, const Graph &g2) {
 
     auto x2 = pathVectorsHelper(g2);
     i = 0;
-    for (uint64_t l : g2.leaves) {
-        std::cout << g2.leafName.at(l) << " ";
+    for (NodeIndex l : g2.leaves) {
+        std::cout << g2.getLeafName(l) << " ";
         std::cout << "Shortest: " << x2[i].first << ", ";
         std::cout << "Longest: " << x2[i].second << std::endl;
         i++;
@@ -1,160 +1,86 @@
 #include "precisionAndRecall.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
-#include <stack>
 #include <unordered_map>
-#include <unordered_set>
 #include <utility>
 #include <vector>
 
-#include "util/clusterTable.h"
+#include "util/clusterIndex.h"
 #include "util/psw.h"
 
-using ClusterMultiset = std::unordered_map<uint64_t, std::unordered_multiset<uint64_t>>;
-using ClusterSet = std::unordered_map<uint64_t, std::unordered_set<uint64_t>>;
+// How many times each cluster is found across the display trees of a
+// graph. Clusters are keyed by their taxa, so the counts don't depend on
+// the order the display trees are enumerated in.
+using ClusterCounts = std::unordered_map<ClusterKey, uint64_t, ClusterKeyHash>;
+
+// Calls f with every cluster of every display tree of g,
+// leaving out the leaves and the root like ClusterTable does.
+template <typename F>
+static void forEachCluster(const Graph &g, F f) {
+    InvariantBlocks blocks(g);
+    DisplayTreeEnumerator e(g, &blocks);
+    ClusterHasher hasher(g, &blocks);
+
+    do {
+        for (const ClusterKey &k : hasher.invariantKeys) {
+            f(k);
+        }
 
-static ClusterMultiset extractClusters(
-    const Graph &g, const std::vector<PSW> &psws
-) {
-    ClusterMultiset res;
+        for (const ClusterKey &k : hasher.hash(e.psw())) {
+            f(k);
+        }
+    } while (e.next());
+}
 
-    for (const PSW &psw : psws) {
-        ClusterTable ct(g, psw);
+static ClusterCounts extractClusters(const Graph &g) {
+    ClusterCounts res;
 
-        for (const auto &l : ct.ct) {
-            res[l.first].insert(l.second.begin(), l.second.end());
-        }
-    }
+    forEachCluster(g, [&](const ClusterKey &k) {
+        res[k]++;
+    });
 
     return res;
 }
 
 // COMCLUST
-template <typename CT>
 static std::pair<double, double> calculatePNR(
-    CT originalCT, const Graph &originalG, const std::vector<PSW> &originalPSWs,
-    const std::unordered_map<std::string, uint64_t> &originalInternalLabels,
-    const CT &compareCT, const Graph &compareG, const std::vector<PSW> &comparePSWs,
-    const std::unordered_map<std::string, uint64_t> &compareInternalLabels
+    ClusterCounts originalCT, const Graph &originalG,
+    const ClusterCounts &compareCT, const Graph &compareG
 ) {
     uint64_t truePositives = 0;
     uint64_t falsePositives = 0;
 
-    for (const PSW &psw : comparePSWs) {
-        std::stack<LRNW> s;
-
-        for (size_t i = 0; i < psw.size(); i++) {
-            const std::pair<uint64_t, uint64_t> p = psw[i];
-
-            uint64_t w = p.second;
-
-            // If leaf
-            if (w == 0) {
-                std::string leafName = compareG.leafName.at(p.first);
-                uint64_t encode = originalInternalLabels.at(leafName);
-
-                s.push({encode, encode, 1, 1});
-            } else {
-                LRNW lrnw = {UINT64_MAX, 0, 0, 1};
+    forEachCluster(compareG, [&](const ClusterKey &k) {
+        auto it = originalCT.find(k);
 
-                do {
-                    LRNW temp = s.top();
-                    s.pop();
-
-                    lrnw.L = std::min(lrnw.L, temp.L);
-                    lrnw.R = std::max(lrnw.R, temp.R);
-                    lrnw.N += temp.N;
-                    lrnw.W += temp.W;
-
-                    w -= temp.W;
-                } while(w != 0);
-
-                s.push(lrnw);
-
-                if (lrnw.N == lrnw.R - lrnw.L + 1) {
-                    auto itL = originalCT.find(lrnw.L);
-
-                    if (itL == originalCT.end()) {
-                        falsePositives++;
-                        continue;
-                    }
-
-                    auto itR = itL->second.find(lrnw.R);
+        if (it == originalCT.end()) {
+            falsePositives++;
+            return;
+        }
 
-                    if (itR != itL->second.end()) {
-                        itL->second.erase(itR);
-                        truePositives++;
-                    } else {
-                        falsePositives++;
-                    }
+        truePositives++;
 
-                    if (itL->second.empty()) {
-                        originalCT.erase(itL);
-                    }
-                }
-            }
+        if (--it->second == 0) {
+            originalCT.erase(it);
         }
-    }
+    });
 
-    for (const auto &l : originalCT) {
-        falsePositives += l.second.size();
+    for (const auto &c : originalCT) {
+        falsePositives += c.second;
     }
 
     uint64_t falseNegatives = 0;
-    for (const auto &l : compareCT) {
-        falseNegatives += l.second.size();
+    for (const auto &c : compareCT) {
+        falseNegatives += c.second;
     }
 
-    for (const PSW &psw : originalPSWs) {
-        std::stack<LRNW> s;
-
-        for (size_t i = 0; i < psw.size(); i++) {
-            const std::pair<uint64_t, uint64_t> p = psw[i];
-
-            uint64_t w = p.second;
-
-            // If leaf
-            if (w == 0) {
-                std::string leafName = originalG.leafName.at(p.first);
-                uint64_t encode = compareInternalLabels.at(leafName);
-
-                s.push({encode, encode, 1, 1});
-            } else {
-                LRNW lrnw = {UINT64_MAX, 0, 0, 1};
-
-                do {
-                    LRNW temp = s.top();
-                    s.pop();
-
-                    lrnw.L = std::min(lrnw.L, temp.L);
-                    lrnw.R = std::max(lrnw.R, temp.R);
-                    lrnw.N += temp.N;
-                    lrnw.W += temp.W;
-
-                    w -= temp.W;
-                } while(w != 0);
-
-                s.push(lrnw);
-
-                if (lrnw.N == lrnw.R - lrnw.L + 1) {
-                    auto itL = compareCT.find(lrnw.L);
-
-                    if (itL == compareCT.end()) {
-                        continue;
-                    }
-
-                    auto itR = itL->second.find(lrnw.R);
-
-                    if (itR != itL->second.end()) {
-                        if (falseNegatives > 0) {
-                            falseNegatives--;
-                        }
-                    }
-                }
-            }
+    forEachCluster(originalG, [&](const ClusterKey &k) {
+        if (falseNegatives > 0 && compareCT.find(k) != compareCT.end()) {
+            falseNegatives--;
         }
-    }
+    });
 
     double precision = 0.0;
     double predictedPositives = truePositives + falsePositives;
@@ -172,66 +98,46 @@ static std::pair<double, double> calculatePNR(
 }
 
 static double calculateF1Score(double precision, double recall) {
+    if (precision + recall == 0.0) {
+        return 0.0;
+    }
+
     return 2.0 * (precision * recall) / (precision + recall);
 }
 
 // Graph g1 is the original
-void precisionAndRecall(const Graph &g1, const Graph &g2) {
+void precisionAndRecall(const Graph &g1, const Graph &g2, const CompareOptions &) {
     if (g1.leaves.size() != g2.leaves.size()) {
         std::cerr << "Trees do not have the same number of leaves." << std::endl;
         std::exit(EXIT_FAILURE);
     }
 
-    std::unordered_set<std::string> leaves1;
-    for (const auto &p : g1.leafName) {
-        leaves1.insert(p.second);
-    }
+    std::vector<NodeIndex> taxa1(g1.leafTaxa);
+    std::sort(taxa1.begin(), taxa1.end());
 
-    std::unordered_set<std::string> leaves2;
-    for (const auto &p : g2.leafName) {
-        leaves2.insert(p.second);
-    }
+    std::vector<NodeIndex> taxa2(g2.leafTaxa);
+    std::sort(taxa2.begin(), taxa2.end());
 
-    if (leaves1 != leaves2) {
+    if (taxa1 != taxa2) {
         std::cerr << "Trees do not have the same leaf names." << std::endl;
         std::exit(EXIT_FAILURE);
     }
 
-    std::vector<PSW> psws1 = genPSWs(g1);
-    std::vector<PSW> psws2 = genPSWs(g2);
-
-    std::unordered_map<std::string, uint64_t> originalInternalLabels;
-    {
-        ClusterTable ct(g1, psws1[0]);
-        originalInternalLabels = std::move(ct.internalLabels);
-    }
-
-    std::unordered_map<std::string, uint64_t> compareInternalLabels;
-    {
-        ClusterTable ct(g2, psws2[0]);
-        compareInternalLabels = std::move(ct.internalLabels);
-    }
-
-    ClusterMultiset originalDup = extractClusters(g1, psws1);
-    ClusterMultiset compareDup = extractClusters(g2, psws2);
+    ClusterCounts originalDup = extractClusters(g1);
+    ClusterCounts compareDup = extractClusters(g2);
 
-    ClusterSet originalUniq(originalDup.size());
-    for (const auto &l : originalDup) {
-        originalUniq[l.first].insert(l.second.begin(), l.second.end());
+    ClusterCounts originalUniq(originalDup);
+    for (auto &c : originalUniq) {
+        c.second = 1;
     }
 
-    ClusterSet compareUniq(compareDup.size());
-    for (const auto &l : compareDup) {
-        compareUniq[l.first].insert(l.second.begin(), l.second.end());
+    ClusterCounts compareUniq(compareDup);
+    for (auto &c : compareUniq) {
+        c.second = 1;
     }
 
     std::cout << "Duplicates clusters:" << std::endl;
-    std::pair<double, double> pnrDup = calculatePNR(
-        originalDup, g1, psws1,
-        originalInternalLabels,
-        compareDup, g2, psws2,
-        compareInternalLabels
-    );
+    std::pair<double, double> pnrDup = calculatePNR(originalDup, g1, compareDup, g2);
 
     double f1scoreDup = calculateF1Score(pnrDup.first, pnrDup.second);
 
@@ -242,12 +148,7 @@ void precisionAndRecall(const Graph &g1, const Graph &g2) {
     std::cout << std::endl;
 
     std::cout << "Unique clusters:" << std::endl;
-    std::pair<double, double> pnrUniq = calculatePNR(
-        originalUniq, g1, psws1,
-        originalInternalLabels,
-        compareUniq, g2, psws2,
-        compareInternalLabels
-    );
+    std::pair<double, double> pnrUniq = calculatePNR(originalUniq, g1, compareUniq, g2);
     double f1scoreUniq = calculateF1Score(pnrUniq.first, pnrUniq.second);
 
     std::cout << "Precision: " << pnrUniq.first << std::endl;
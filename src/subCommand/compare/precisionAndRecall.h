@@ -1,6 +1,7 @@
 #pragma once
 
+#include "compareOptions.h"
 #include "../../graph.h"
 
 // Graph g1 is the original
-void precisionAndRecall(const Graph &g1, const Graph &g2);
+void precisionAndRecall(const Graph &g1, const Graph &g2, const CompareOptions &opts);
@@ -6,28 +6,36 @@
 #include <cstdlib>
 // #include <iomanip>
 #include <iostream>
-#include <stack>
-#include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#include "util/clusterIndex.h"
 #include "util/clusterTable.h"
 #include "util/lap.h"
 #include "util/psw.h"
 
+// The cost matrix is padded to a square when the graphs have different
+// numbers of display trees, pairs with a padding row or column are skipped.
 static void printBipartiteStats(
     const std::vector<std::vector<cost>> &costMatrix,
     const std::vector<std::vector<uint64_t>> &similarity,
     const std::vector<col> &rowSol
 ) {
-    uint64_t min = costMatrix[0][rowSol[0]];
-    uint64_t max = costMatrix[0][rowSol[0]];
-    double total = costMatrix[0][rowSol[0]];
-    double similarityTotal = similarity[0][rowSol[0]];
+    size_t n = similarity.size();
+    size_t m = similarity[0].size();
+
+    uint64_t min = UINT64_MAX;
+    uint64_t max = 0;
+    double total = 0;
+    double similarityTotal = 0;
+    size_t numPairs = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (static_cast<size_t>(rowSol[i]) >= m) {
+            continue;
+        }
 
-    for (size_t i = 1; i < rowSol.size(); i++) {
         cost dissimilarity = costMatrix[i][rowSol[i]];
 
         if (dissimilarity < min) {
@@ -39,6 +47,7 @@ static void printBipartiteStats(
 
         total += dissimilarity;
         similarityTotal += similarity[i][rowSol[i]];
+        numPairs++;
     }
 
     std::cout << total / (total + similarityTotal) * 100.0 << "% difference" << std::endl;
@@ -47,7 +56,7 @@ static void printBipartiteStats(
     std::cout << "total: " << total;
     std::cout << ", min: " << min;
     std::cout << ", max: " << max;
-    std::cout << ", avg: " << total / rowSol.size() << std::endl;
+    std::cout << ", avg: " << total / numPairs << std::endl;
 
     /* int width1 = 5;
     int width2 = 7;
@@ -108,14 +117,14 @@ static void printSmallestSumStats(
 
 static void printClusterStats(
     const Graph &g,
-    std::vector<ClusterTable> cts
+    const std::vector<uint64_t> &clusterSizes
 ) {
-    uint64_t minCluster = cts[0].size;
-    double sumCluster = cts[0].size;
-    uint64_t maxCluster = cts[0].size;
+    uint64_t minCluster = clusterSizes[0];
+    double sumCluster = clusterSizes[0];
+    uint64_t maxCluster = clusterSizes[0];
 
-    for (size_t i = 1; i < cts.size(); i++) {
-        uint64_t s = cts[i].size;
+    for (size_t i = 1; i < clusterSizes.size(); i++) {
+        uint64_t s = clusterSizes[i];
 
         if (s < minCluster) {
             minCluster = s;
@@ -131,37 +140,47 @@ static void printClusterStats(
     std::cout << "total (considering every contained subtree): " << sumCluster << std::endl;
     std::cout << "min: " << minCluster;
     std::cout << ", max: " << maxCluster;
-    std::cout << ", avg: " << sumCluster / cts.size() << std::endl;
+    std::cout << ", avg: " << sumCluster / clusterSizes.size() << std::endl;
 }
 
 // COMCLUST
-// Returns a pair (dissimilarity, similarity)
-static std::pair<uint64_t, uint64_t> rfDist(
+// Returns the number of clusters of psw2 that are also in ct1. Blocks
+// standing in for their leaves are pushed as blockLRNW[block].
+// s is only scratch space, passed in so its memory can be reused.
+static uint64_t commonClusters(
     const ClusterTable &ct1,
-    const ClusterTable &ct2,
-    const Graph &g2, const PSW &psw2
+    const Graph &g2, const PSW &psw2,
+    const InvariantBlocks &blocks2,
+    const std::vector<LRNW> &blockLRNW,
+    std::vector<LRNW> &s
 ) {
-    uint64_t commonClusters = 0;
+    uint64_t res = 0;
 
-    std::stack<LRNW> s;
+    s.clear();
 
     for (size_t i = 0; i < psw2.size(); i++) {
-        const std::pair<uint64_t, uint64_t> p = psw2[i];
+        const std::pair<NodeIndex, NodeIndex> p = psw2[i];
 
-        uint64_t w = p.second;
+        NodeIndex w = p.second;
 
         // If leaf
         if (w == 0) {
-            std::string leafName = g2.leafName.at(p.first);
-            uint64_t encode = ct1.encode(leafName);
+            NodeIndex b = blocks2.getBlock(p.first);
+
+            if (b != NO_BLOCK) {
+                s.push_back(blockLRNW[b]);
+                continue;
+            }
+
+            NodeIndex encode = ct1.encode(g2.getTaxon(p.first));
 
-            s.push({encode, encode, 1, 1});
+            s.push_back({encode, encode, 1, 1});
         } else {
-            LRNW lrnw = {UINT64_MAX, 0, 0, 1};
+            LRNW lrnw = {NO_INDEX, 0, 0, 1};
 
             do {
-                LRNW temp = s.top();
-                s.pop();
+                LRNW temp = s.back();
+                s.pop_back();
 
                 lrnw.L = std::min(lrnw.L, temp.L);
                 lrnw.R = std::max(lrnw.R, temp.R);
@@ -171,93 +190,271 @@ static std::pair<uint64_t, uint64_t> rfDist(
                 w -= temp.W;
             } while(w != 0);
 
-            s.push(lrnw);
+            s.push_back(lrnw);
 
             if (lrnw.N == lrnw.R - lrnw.L + 1
             && ct1.isClust(lrnw.L, lrnw.R)) {
-                commonClusters++;
+                res++;
+            }
+        }
+    }
+
+    return res;
+}
+
+// Row i of each is about the i-th display tree of g1,
+// column j about the j-th display tree of g2.
+struct RFResults {
+    std::vector<std::vector<cost>> costMatrix;
+    std::vector<std::vector<uint64_t>> similarity;
+
+    std::vector<uint64_t> clusterSizes1;
+    std::vector<uint64_t> clusterSizes2;
+
+    std::vector<uint64_t> minDissimilarity;
+    std::vector<uint64_t> minSimilarity;
+};
+
+// Fills in rows [first, last). Every row is written by exactly one call,
+// so calls on disjoint ranges can run at the same time.
+static void rfRows(
+    const Graph &g1, const Graph &g2,
+    const InvariantBlocks &blocks2,
+    size_t first, size_t last,
+    RFResults &res
+) {
+    // Display trees are streamed rather than stored: g2's are
+    // regenerated for every display tree of g1, without their blocks.
+    DisplayTreeEnumerator e1(g1);
+    DisplayTreeEnumerator e2(g2, &blocks2);
+
+    std::vector<LRNW> s;
+    std::vector<LRNW> blockLRNW(blocks2.roots.size());
+
+    for (size_t i = 0; i < first; i++) {
+        e1.next();
+    }
+
+    for (size_t i = first; i < last; i++) {
+        if (i != first) {
+            e1.next();
+        }
+
+        ClusterTable ct1(g1, e1.psw());
+        res.clusterSizes1[i] = ct1.size;
+
+        // The blocks are in every display tree of g2,
+        // so they're only compared to ct1 once.
+        uint64_t invariantCommon = 0;
+
+        for (NodeIndex b = 0; b < blockLRNW.size(); b++) {
+            if (blocks2.psws[b].empty()) {
+                continue;
+            }
+
+            invariantCommon += commonClusters(ct1, g2, blocks2.psws[b], blocks2, blockLRNW, s);
+
+            blockLRNW[b] = s.back();
+            blockLRNW[b].W = 1;
+        }
+
+        size_t j = 0;
+        e2.reset();
+
+        do {
+            uint64_t common = invariantCommon
+                + commonClusters(ct1, g2, e2.psw(), blocks2, blockLRNW, s);
+            uint64_t dist = ct1.size + res.clusterSizes2[j] - 2 * common;
+
+            res.costMatrix[i][j] = static_cast<cost>(dist);
+            res.similarity[i][j] = common;
+
+            j++;
+        } while (e2.next());
+    }
+}
+
+// Same as rfRows, but fills in columns [first, last) by looking up
+// every cluster of g2's display trees in the index of g1's clusters,
+// so the work grows with the number of shared clusters instead of n * m.
+// invariantSimilarity[i] is how many clusters in g2's blocks are
+// in the i-th display tree of g1.
+static void rfColumns(
+    const ClusterIndex &index,
+    const Graph &g2, const InvariantBlocks &blocks2,
+    const std::vector<uint64_t> &invariantSimilarity,
+    size_t first, size_t last,
+    RFResults &res
+) {
+    DisplayTreeEnumerator e2(g2, &blocks2);
+    ClusterHasher hasher(g2, &blocks2);
+
+    for (size_t j = 0; j < first; j++) {
+        e2.next();
+    }
+
+    for (size_t j = first; j < last; j++) {
+        if (j != first) {
+            e2.next();
+        }
+
+        const std::vector<ClusterKey> &keys = hasher.hash(e2.psw());
+        res.clusterSizes2[j] = hasher.invariantKeys.size() + keys.size();
+
+        // Clusters shared with every display tree of g1.
+        uint64_t shared = 0;
+
+        for (const ClusterKey &k : keys) {
+            if (index.inEveryTree(k)) {
+                shared++;
+                continue;
+            }
+
+            const std::vector<uint64_t> *trees = index.find(k);
+
+            if (trees == nullptr) {
+                continue;
+            }
+
+            for (const uint64_t &i : *trees) {
+                res.similarity[i][j]++;
             }
         }
+
+        for (size_t i = 0; i < res.similarity.size(); i++) {
+            uint64_t sim = res.similarity[i][j] += invariantSimilarity[i] + shared;
+            uint64_t dist = res.clusterSizes1[i] + res.clusterSizes2[j] - 2 * sim;
+            res.costMatrix[i][j] = static_cast<cost>(dist);
+        }
+    }
+}
+
+// Runs f(first, last) on contiguous ranges of [0, count),
+// one per thread, so the results don't depend on the number of threads.
+template <typename F>
+static void forRanges(size_t count, unsigned int numThreads, F f) {
+    size_t numRanges = std::min<size_t>(numThreads, count);
+    size_t rangeSize = (count + numRanges - 1) / numRanges;
+
+    std::vector<std::thread> threads;
+    threads.reserve(numRanges);
+
+    for (size_t first = 0; first < count; first += rangeSize) {
+        size_t last = std::min(first + rangeSize, count);
+        threads.emplace_back(f, first, last);
     }
 
-    uint64_t dissimilarity = ct1.size + ct2.size - 2 * commonClusters;
-    return std::make_pair(dissimilarity, commonClusters);
+    for (std::thread &t : threads) {
+        t.join();
+    }
 }
 
-void robinsonFoulds(const Graph &g1, const Graph &g2) {
+void robinsonFoulds(const Graph &g1, const Graph &g2, const CompareOptions &opts) {
     if (g1.leaves.size() != g2.leaves.size()) {
         std::cerr << "Trees do not have the same number of leaves." << std::endl;
         std::exit(EXIT_FAILURE);
     }
 
-    std::unordered_set<std::string> leaves1;
-    for (const auto &p : g1.leafName) {
-        leaves1.insert(p.second);
-    }
+    std::vector<NodeIndex> taxa1(g1.leafTaxa);
+    std::sort(taxa1.begin(), taxa1.end());
 
-    std::unordered_set<std::string> leaves2;
-    for (const auto &p : g2.leafName) {
-        leaves2.insert(p.second);
-    }
+    std::vector<NodeIndex> taxa2(g2.leafTaxa);
+    std::sort(taxa2.begin(), taxa2.end());
 
-    if (leaves1 != leaves2) {
+    if (taxa1 != taxa2) {
         std::cerr << "Trees do not have the same leaf names." << std::endl;
         std::exit(EXIT_FAILURE);
     }
 
+    // Day codes number the leaves while cluster keys sum their taxa, so
+    // the two ways of comparing only agree when no name repeats.
+    if (std::adjacent_find(taxa1.begin(), taxa1.end()) != taxa1.end()) {
+        std::cerr << "Trees have more than one leaf with the same name." << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
     /* if (g1.reticulations.size() != g2.reticulations.size()) {
         std::cerr << "Trees do not have the same number of reticulations." << std::endl;
         std::exit(EXIT_FAILURE);
     } */
 
-    std::vector<PSW> psws1 = genPSWs(g1);
-    std::vector<PSW> psws2 = genPSWs(g2);
+    DisplayTreeEnumerator e1(g1);
+    DisplayTreeEnumerator e2(g2);
 
-    size_t n = psws1.size();
-    size_t m = psws2.size();
+    size_t n = e1.getNumTrees();
+    size_t m = e2.getNumTrees();
     size_t size = std::max(n, m);
 
-    std::vector<ClusterTable> cts1;
-    cts1.reserve(n);
-    std::vector<ClusterTable> cts2;
-    cts2.reserve(m);
+    RFResults res;
+    res.costMatrix.assign(size, std::vector<cost>(size, 0.0));
+    res.similarity.assign(n, std::vector<uint64_t>(m));
+    res.clusterSizes1.resize(n);
+    res.clusterSizes2.resize(m);
+    res.minDissimilarity.resize(n);
+    res.minSimilarity.resize(n);
+
+    // Clusters in subtrees without reticulations are the same in every
+    // display tree of g2, so they're set aside and only compared once.
+    InvariantBlocks blocks2(g2);
+
+    if (opts.clusterIndex) {
+        ClusterIndex index(g1);
+        res.clusterSizes1 = index.clusterSizes;
+
+        std::vector<uint64_t> invariantSimilarity(n, 0);
+        uint64_t shared = 0;
+
+        for (const ClusterKey &k : ClusterHasher(g2, &blocks2).invariantKeys) {
+            if (index.inEveryTree(k)) {
+                shared++;
+                continue;
+            }
 
-    for (size_t i = 0; i < n; i++) {
-        cts1.emplace_back(g1, psws1[i]);
-    }
+            const std::vector<uint64_t> *trees = index.find(k);
 
-    for (size_t i = 0; i < m; i++) {
-        cts2.emplace_back(g2, psws2[i]);
-    }
+            if (trees == nullptr) {
+                continue;
+            }
 
-    std::vector<std::vector<cost>> costMatrix(size, std::vector<cost>(size, 0.0));
-    std::vector<std::vector<uint64_t>> similarity(n, std::vector<uint64_t>(m));
+            for (const uint64_t &i : *trees) {
+                invariantSimilarity[i]++;
+            }
+        }
 
-    std::vector<uint64_t> minDissimilarity;
-    minDissimilarity.reserve(n);
-    std::vector<uint64_t> minSimilarity;
-    minSimilarity.reserve(n);
+        for (uint64_t &sim : invariantSimilarity) {
+            sim += shared;
+        }
+
+        forRanges(m, opts.numThreads, [&](size_t first, size_t last) {
+            rfColumns(index, g2, blocks2, invariantSimilarity, first, last, res);
+        });
+    } else {
+        size_t j = 0;
+
+        do {
+            res.clusterSizes2[j++] = ClusterTable(g2, e2.psw()).size;
+        } while (e2.next());
+
+        forRanges(n, opts.numThreads, [&](size_t first, size_t last) {
+            rfRows(g1, g2, blocks2, first, last, res);
+        });
+    }
 
     for (size_t i = 0; i < n; i++) {
         uint64_t minDist = UINT64_MAX;
         uint64_t minSim = 0;
 
         for (size_t j = 0; j < m; j++) {
-            auto p = rfDist(cts1[i], cts2[j], g2, psws2[j]);
-            uint64_t dist = p.first;
-            uint64_t sim = p.second;
-
-            costMatrix[i][j] = static_cast<cost>(dist);
-            similarity[i][j] = sim;
+            uint64_t dist = res.costMatrix[i][j];
 
             if (dist < minDist) {
                 minDist = dist;
-                minSim = sim;
+                minSim = res.similarity[i][j];
             }
         }
 
-        minDissimilarity.push_back(minDist);
-        minSimilarity.push_back(minSim);
+        res.minDissimilarity[i] = minDist;
+        res.minSimilarity[i] = minSim;
     }
 
     std::vector<col> rowSol(size);
@@ -265,18 +462,18 @@ void robinsonFoulds(const Graph &g1, const Graph &g2) {
     std::vector<cost> u(size);
     std::vector<cost> v(size);
 
-    lap(size, costMatrix, rowSol, colSol, u, v);
+    lap(size, res.costMatrix, rowSol, colSol, u, v);
 
     std::cout << "===Bipartite matching===" << std::endl;
-    printBipartiteStats(costMatrix, similarity, rowSol);
+    printBipartiteStats(res.costMatrix, res.similarity, rowSol);
     std::cout << std::endl;
 
     std::cout << "===Sum of the smallest===" << std::endl;
-    printSmallestSumStats(minDissimilarity, minSimilarity);
+    printSmallestSumStats(res.minDissimilarity, res.minSimilarity);
     std::cout << std::endl;
 
     std::cout << "===Non-trivial clades/clusters===" << std::endl;
-    printClusterStats(g1, cts1);
+    printClusterStats(g1, res.clusterSizes1);
     std::cout << std::endl;
-    printClusterStats(g2, cts2);
+    printClusterStats(g2, res.clusterSizes2);
 }
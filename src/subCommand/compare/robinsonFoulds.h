@@ -1,5 +1,6 @@
 #pragma once
 
+#include "compareOptions.h"
 #include "../../graph.h"
 
-void robinsonFoulds(const Graph &g1, const Graph &g2);
+void robinsonFoulds(const Graph &g1, const Graph &g2, const CompareOptions &opts);
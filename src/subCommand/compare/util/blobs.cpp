@@ -0,0 +1,203 @@
+#include "blobs.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Edges are numbered by their position in g.childTargets, and edgeOf
+// gives the number of the edge into each entry of g.parentTargets.
+struct BlobSearch {
+    const Graph &g;
+    std::vector<NodeIndex> edgeOf;
+
+    std::vector<NodeIndex> disc;
+    std::vector<NodeIndex> low;
+    NodeIndex time;
+
+    std::vector<NodeIndex> edges;
+    std::vector<NodeIndex> componentOf;
+    std::vector<NodeIndex> componentSize;
+};
+
+// Called once the search is done with target, which it reached from
+// node through edge.
+static void finishEdge(BlobSearch &bs, NodeIndex node, NodeIndex target, NodeIndex edge) {
+    bs.low[node] = std::min(bs.low[node], bs.low[target]);
+
+    // node separates target's side from the rest,
+    // so the edges pushed since edge make up a component.
+    if (bs.low[target] >= bs.disc[node]) {
+        NodeIndex component = bs.componentSize.size();
+        bs.componentSize.push_back(0);
+
+        NodeIndex e;
+
+        do {
+            e = bs.edges.back();
+            bs.edges.pop_back();
+
+            bs.componentOf[e] = component;
+            bs.componentSize[component]++;
+        } while (e != edge);
+    }
+}
+
+// Tarjan's biconnected components over the underlying undirected graph,
+// on an explicit stack since it goes as deep as the network.
+static void search(BlobSearch &bs, NodeIndex start) {
+    const Graph &g = bs.g;
+
+    // A node, the edge the search came in through and the next of its
+    // edges to look at, children first and then parents.
+    struct Frame {
+        NodeIndex node;
+        NodeIndex parentEdge;
+        NodeIndex next;
+    };
+
+    std::vector<Frame> stack;
+
+    bs.disc[start] = bs.low[start] = bs.time++;
+    stack.push_back({start, NO_INDEX, 0});
+
+    while (!stack.empty()) {
+        Frame &f = stack.back();
+        NodeIndex node = f.node;
+        NodeIndex numChildren = g.childOffsets[node + 1] - g.childOffsets[node];
+        NodeIndex numParents = g.parentOffsets[node + 1] - g.parentOffsets[node];
+
+        if (f.next == numChildren + numParents) {
+            NodeIndex parentEdge = f.parentEdge;
+            stack.pop_back();
+
+            if (!stack.empty()) {
+                finishEdge(bs, stack.back().node, node, parentEdge);
+            }
+
+            continue;
+        }
+
+        NodeIndex k = f.next++;
+        NodeIndex edge;
+        NodeIndex target;
+
+        if (k < numChildren) {
+            edge = g.childOffsets[node] + k;
+            target = g.childTargets[edge];
+        } else {
+            NodeIndex i = g.parentOffsets[node] + k - numChildren;
+            edge = bs.edgeOf[i];
+            target = g.parentTargets[i];
+        }
+
+        if (edge == f.parentEdge) {
+            continue;
+        }
+
+        if (bs.disc[target] != NO_INDEX) {
+            if (bs.disc[target] < bs.disc[node]) {
+                bs.edges.push_back(edge);
+                bs.low[node] = std::min(bs.low[node], bs.disc[target]);
+            }
+
+            continue;
+        }
+
+        bs.edges.push_back(edge);
+        bs.disc[target] = bs.low[target] = bs.time++;
+        stack.push_back({target, edge, 0});
+    }
+}
+
+static NodeIndex findSet(std::vector<NodeIndex> &parent, NodeIndex x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+
+    return x;
+}
+
+Blobs::Blobs(const Graph &g) {
+    NodeIndex numNodes = g.getNumNodes();
+    NodeIndex numEdges = g.getNumEdges();
+
+    BlobSearch bs = {g};
+    bs.edgeOf.resize(numEdges);
+    bs.disc.assign(numNodes, NO_INDEX);
+    bs.low.assign(numNodes, NO_INDEX);
+    bs.time = 0;
+    bs.componentOf.assign(numEdges, NO_INDEX);
+
+    // Same order Graph::freeze fills parentTargets in.
+    std::vector<NodeIndex> parentPos(g.parentOffsets.begin(), g.parentOffsets.end() - 1);
+
+    for (NodeIndex n = 0; n < numNodes; n++) {
+        for (NodeIndex e = g.childOffsets[n]; e < g.childOffsets[n + 1]; e++) {
+            bs.edgeOf[parentPos[g.childTargets[e]]++] = e;
+        }
+    }
+
+    search(bs, g.root);
+
+    // A component of a single edge is a cut edge, anything bigger is a
+    // blob. Blobs sharing a node with child edges in both get merged.
+    std::vector<NodeIndex> parent(bs.componentSize.size());
+
+    for (NodeIndex c = 0; c < parent.size(); c++) {
+        parent[c] = c;
+    }
+
+    blobOf.assign(numNodes, NO_BLOB);
+
+    for (NodeIndex n = 0; n < numNodes; n++) {
+        for (NodeIndex e = g.childOffsets[n]; e < g.childOffsets[n + 1]; e++) {
+            NodeIndex c = bs.componentOf[e];
+
+            if (c == NO_INDEX || bs.componentSize[c] == 1) {
+                continue;
+            }
+
+            if (blobOf[n] == NO_BLOB) {
+                blobOf[n] = c;
+            } else {
+                parent[findSet(parent, c)] = findSet(parent, blobOf[n]);
+            }
+        }
+    }
+
+    // Number the merged blobs 0, 1, ...
+    std::vector<NodeIndex> index(parent.size(), NO_BLOB);
+
+    for (NodeIndex n = 0; n < numNodes; n++) {
+        if (blobOf[n] == NO_BLOB) {
+            continue;
+        }
+
+        NodeIndex c = findSet(parent, blobOf[n]);
+
+        if (index[c] == NO_BLOB) {
+            index[c] = reticulations.size();
+            reticulations.emplace_back();
+        }
+
+        blobOf[n] = index[c];
+    }
+
+    // The edges into a reticulation are on a cycle, so they're in the
+    // same blob as the other child edges of the reticulation's parents.
+    for (const NodeIndex &r : g.reticulationNodes) {
+        NodeSpan parents = g.parents(r);
+
+        // Nothing to switch to
+        if (parents.size() < 2 || blobOf[parents[0]] == NO_BLOB) {
+            continue;
+        }
+
+        reticulations[blobOf[parents[0]]].push_back(r);
+    }
+}
+
+NodeIndex Blobs::getBlob(NodeIndex node) const {
+    return blobOf[node];
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../../../graph.h"
+
+// getBlob value of a node whose cluster is the same in every display tree.
+const NodeIndex NO_BLOB = NO_INDEX;
+
+// Splits a network into its blobs, the biconnected components with a
+// reticulation in them. Everything under a cut edge hangs off the rest
+// of the network only through that edge, so the leaves under it are the
+// same in every display tree. A node's cluster then only depends on the
+// parents chosen by the reticulations of the blob its child edges are in,
+// and each blob's display trees can be enumerated on their own.
+// Blobs that share a node with child edges in both are merged.
+struct Blobs {
+public:
+    Blobs(const Graph &g);
+
+    // The blob whose reticulations decide the node's cluster.
+    NodeIndex getBlob(NodeIndex node) const;
+
+public:
+    // The reticulation nodes of each blob.
+    std::vector<std::vector<NodeIndex>> reticulations;
+
+    std::vector<NodeIndex> blobOf;
+};
@@ -0,0 +1,150 @@
+#include "clusterIndex.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "blobs.h"
+
+// splitmix64
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+static ClusterKey taxonKey(uint64_t taxon) {
+    return {mix(2 * taxon), mix(2 * taxon + 1)};
+}
+
+ClusterHasher::ClusterHasher(const Graph &g, const InvariantBlocks *blocks)
+: g(g), blocks(blocks) {
+    if (blocks == nullptr) {
+        return;
+    }
+
+    blockKeys.resize(blocks->roots.size());
+
+    for (NodeIndex b = 0; b < blocks->roots.size(); b++) {
+        blockKeys[b] = hashInto(blocks->psws[b], true, invariantKeys, nullptr);
+    }
+}
+
+const std::vector<ClusterKey> &ClusterHasher::hash(const PSW &psw) {
+    keys.clear();
+    keyNodes.clear();
+    hashInto(psw, false, keys, &keyNodes);
+    return keys;
+}
+
+const std::vector<NodeIndex> &ClusterHasher::nodes() const {
+    return keyNodes;
+}
+
+ClusterKey ClusterHasher::hashInto(
+    const PSW &psw, bool withRoot,
+    std::vector<ClusterKey> &out, std::vector<NodeIndex> *outNodes
+) {
+    prefix.resize(psw.size() + 1);
+    prefix[0] = {0, 0};
+
+    for (size_t i = 0; i < psw.size(); i++) {
+        const std::pair<NodeIndex, NodeIndex> p = psw[i];
+
+        // If leaf, or a block standing in for its leaves
+        if (p.second == 0) {
+            NodeIndex b = blocks != nullptr ? blocks->getBlock(p.first) : NO_BLOCK;
+            ClusterKey k = b != NO_BLOCK ? blockKeys[b] : taxonKey(g.getTaxon(p.first));
+
+            prefix[i + 1] = {prefix[i].h1 + k.h1, prefix[i].h2 + k.h2};
+        } else {
+            prefix[i + 1] = prefix[i];
+
+            // The node's subtree is psw[i - weight, i].
+            if (withRoot || i + 1 != psw.size()) {
+                const ClusterKey &first = prefix[i - p.second];
+                out.push_back({prefix[i].h1 - first.h1, prefix[i].h2 - first.h2});
+
+                if (outNodes != nullptr) {
+                    outNodes->push_back(p.first);
+                }
+            }
+        }
+    }
+
+    return prefix[psw.size()];
+}
+
+ClusterIndex::ClusterIndex(const Graph &g) {
+    InvariantBlocks blocks(g);
+    DisplayTreeEnumerator e(g, &blocks);
+    ClusterHasher hasher(g, &blocks);
+    uint64_t tree = 0;
+
+    everyTree.insert(hasher.invariantKeys.begin(), hasher.invariantKeys.end());
+
+    do {
+        const std::vector<ClusterKey> &keys = hasher.hash(e.psw());
+
+        for (const ClusterKey &k : keys) {
+            trees[k].push_back(tree);
+        }
+
+        clusterSizes.push_back(hasher.invariantKeys.size() + keys.size());
+        tree++;
+    } while (e.next());
+}
+
+bool ClusterIndex::inEveryTree(const ClusterKey &k) const {
+    return everyTree.find(k) != everyTree.end();
+}
+
+const std::vector<uint64_t> *ClusterIndex::find(const ClusterKey &k) const {
+    auto it = trees.find(k);
+
+    if (it == trees.end()) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+
+ClusterSet displayedClusters(const Graph &g) {
+    InvariantBlocks blocks(g);
+    Blobs blobs(g);
+
+    DisplayTreeEnumerator e(g, &blocks);
+    ClusterHasher hasher(g, &blocks);
+
+    ClusterSet res(hasher.invariantKeys.begin(), hasher.invariantKeys.end());
+
+    // Clusters of nodes outside of every blob are the same in
+    // every display tree, so the first one has all of them.
+    {
+        const std::vector<ClusterKey> &keys = hasher.hash(e.psw());
+
+        for (size_t k = 0; k < keys.size(); k++) {
+            if (blobs.getBlob(hasher.nodes()[k]) == NO_BLOB) {
+                res.insert(keys[k]);
+            }
+        }
+    }
+
+    // The clusters of a blob's nodes only depend on its own reticulations.
+    for (NodeIndex b = 0; b < blobs.reticulations.size(); b++) {
+        e.restrictTo(blobs.reticulations[b]);
+
+        do {
+            const std::vector<ClusterKey> &keys = hasher.hash(e.psw());
+
+            for (size_t k = 0; k < keys.size(); k++) {
+                if (blobs.getBlob(hasher.nodes()[k]) == b) {
+                    res.insert(keys[k]);
+                }
+            }
+        } while (e.next());
+    }
+
+    return res;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../../../graph.h"
+#include "psw.h"
+
+// Identifies a cluster by its set of taxa: every taxon is given two
+// random 64 bit numbers and a cluster's key is their sum. The same taxa
+// give the same key in any display tree of any graph, and with 128 bits
+// two different clusters colliding is too unlikely to matter.
+struct ClusterKey {
+    uint64_t h1, h2;
+
+    bool operator==(const ClusterKey &o) const {
+        return h1 == o.h1 && h2 == o.h2;
+    }
+};
+
+struct ClusterKeyHash {
+    size_t operator()(const ClusterKey &k) const {
+        return k.h1;
+    }
+};
+
+// Finds the keys of the clusters of a display tree, leaving out the
+// leaves and the root like ClusterTable does. Its buffers are kept
+// between calls, so each thread should have its own.
+struct ClusterHasher {
+public:
+    // If given blocks, the PSWs passed to hash() are expected to come from
+    // a DisplayTreeEnumerator that was given the same blocks.
+    ClusterHasher(const Graph &g, const InvariantBlocks *blocks = nullptr);
+
+    // Only has the clusters outside of the blocks.
+    // Only valid until the next call.
+    const std::vector<ClusterKey> &hash(const PSW &psw);
+
+    // nodes()[k] is the node of the k-th cluster of the last hash() call.
+    const std::vector<NodeIndex> &nodes() const;
+
+public:
+    // The clusters inside the blocks, which are in every display tree.
+    std::vector<ClusterKey> invariantKeys;
+
+private:
+    // Appends the keys of the clusters of psw to out, the last one only
+    // if withRoot, and returns the sum of the keys of its leaves.
+    // The nodes of the clusters go in outNodes, unless it's nullptr.
+    ClusterKey hashInto(
+        const PSW &psw, bool withRoot,
+        std::vector<ClusterKey> &out, std::vector<NodeIndex> *outNodes
+    );
+
+private:
+    const Graph &g;
+    const InvariantBlocks *blocks;
+
+    // Sum of the keys of the leaves of each block.
+    std::vector<ClusterKey> blockKeys;
+
+    // prefix[k] is the sum of the keys of the leaves in psw[0, k).
+    std::vector<ClusterKey> prefix;
+    std::vector<ClusterKey> keys;
+    std::vector<NodeIndex> keyNodes;
+};
+
+// Inverted index from each cluster to the display trees of a graph
+// it's found in, in the order DisplayTreeEnumerator visits them.
+// Clusters found in every display tree are kept apart, so they don't
+// need a list with every tree in it.
+struct ClusterIndex {
+public:
+    ClusterIndex(const Graph &g);
+
+    bool inEveryTree(const ClusterKey &k) const;
+
+    // Returns nullptr if the cluster is in every display tree or in none.
+    const std::vector<uint64_t> *find(const ClusterKey &k) const;
+
+public:
+    std::unordered_set<ClusterKey, ClusterKeyHash> everyTree;
+    std::unordered_map<ClusterKey, std::vector<uint64_t>, ClusterKeyHash> trees;
+
+    // Number of clusters in each display tree.
+    std::vector<uint64_t> clusterSizes;
+};
+
+using ClusterSet = std::unordered_set<ClusterKey, ClusterKeyHash>;
+
+// Every cluster found in at least one display tree of g. The blobs of g
+// are enumerated one at a time, so the work is the sum of their numbers
+// of display trees instead of the product.
+ClusterSet displayedClusters(const Graph &g);
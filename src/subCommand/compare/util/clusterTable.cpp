@@ -2,58 +2,76 @@
 
 #include <cstdint>
 #include <iostream>
-#include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "../../../taxa.h"
 
 ClusterTable::ClusterTable(const Graph &g, const PSW &psw) {
     size = 0;
 
-    uint64_t leafCode = 0;
-    internalLabels.reserve(g.leafName.size());
+    size_t numLeaves = g.leaves.size();
+
+    rightOf.assign(numLeaves, NO_INDEX);
+    leftOf.assign(numLeaves, NO_INDEX);
+    internalLabels.assign(taxa.size(), NO_INDEX);
 
-    uint64_t rightLeaf = 0;
+    NodeIndex leafCode = 0;
+    NodeIndex rightLeaf = 0;
 
     for (size_t i = 0; i < psw.size() - 1; i++) {
-        const std::pair<uint64_t, uint64_t> p = psw[i];
+        const std::pair<NodeIndex, NodeIndex> p = psw[i];
 
         // If leaf
         if (p.second == 0) {
-            std::string leafName = g.leafName.at(p.first);
-            internalLabels[leafName] = leafCode;
+            internalLabels[g.getTaxon(p.first)] = leafCode;
 
             rightLeaf = leafCode;
             leafCode++;
         } else {
-            uint64_t leftLeafIndex = psw[i - p.second].first;
-            std::string leafName = g.leafName.at(leftLeafIndex);
-            uint64_t leftLeaf = internalLabels[leafName];
+            NodeIndex leftLeafIndex = psw[i - p.second].first;
+            NodeIndex leftLeaf = internalLabels[g.getTaxon(leftLeafIndex)];
+
+            // The node right after a last child in post order is its parent.
+            bool isLastChild = psw[i + 1].second != 0;
+            NodeIndex &slot = isLastChild ? rightOf[leftLeaf] : leftOf[rightLeaf];
+            NodeIndex value = isLastChild ? rightLeaf : leftLeaf;
 
-            if (ct[leftLeaf].insert(rightLeaf).second) {
+            if (slot != value) {
+                slot = value;
                 size++;
             }
         }
     }
 }
 
-uint64_t ClusterTable::encode(const std::string &l) const {
-    return internalLabels.at(l);
+NodeIndex ClusterTable::encode(NodeIndex taxon) const {
+    return internalLabels[taxon];
+}
+
+bool ClusterTable::isClust(NodeIndex L, NodeIndex R) const {
+    return (rightOf[L] == R) | (leftOf[R] == L);
 }
 
-bool ClusterTable::isClust(uint64_t L, uint64_t R) const {
-    auto itL = ct.find(L);
+std::vector<std::pair<NodeIndex, NodeIndex>> ClusterTable::getClusters() const {
+    std::vector<std::pair<NodeIndex, NodeIndex>> res;
+    res.reserve(size);
 
-    if (itL == ct.end()) {
-        return false;
+    for (NodeIndex i = 0; i < rightOf.size(); i++) {
+        if (rightOf[i] != NO_INDEX) {
+            res.emplace_back(i, rightOf[i]);
+        }
+
+        if (leftOf[i] != NO_INDEX) {
+            res.emplace_back(leftOf[i], i);
+        }
     }
 
-    return itL->second.find(R) != itL->second.end();
+    return res;
 }
 
 void ClusterTable::print() const {
-    for (const auto &l : ct) {
-        for (const auto &r : l.second) {
-            std::cout << l.first << ", " << r << std::endl;
-        }
+    for (const auto &c : getClusters()) {
+        std::cout << c.first << ", " << c.second << std::endl;
     }
 }
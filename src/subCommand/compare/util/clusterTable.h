@@ -1,30 +1,41 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
-#include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "../../../graph.h"
 #include "psw.h"
 
 struct LRNW {
-    uint64_t L, R, N, W;
+    NodeIndex L, R, N, W;
 };
 
+// Day's cluster table. Leaves are encoded in the order they appear in
+// the PSW, so every cluster is an interval [L, R] of codes. A cluster
+// that is the last child of its parent is stored in row L, any other
+// in row R; no two clusters of a tree end up in the same row.
 struct ClusterTable {
 public:
     ClusterTable(const Graph &g, const PSW &psw);
 
-    uint64_t encode(const std::string &l) const;
+    // Takes the taxon id of a leaf.
+    NodeIndex encode(NodeIndex taxon) const;
 
-    bool isClust(uint64_t L, uint64_t R) const;
+    bool isClust(NodeIndex L, NodeIndex R) const;
+
+    std::vector<std::pair<NodeIndex, NodeIndex>> getClusters() const;
 
     void print() const;
 
 public:
-    std::unordered_map<uint64_t, std::unordered_set<uint64_t>> ct;
-    std::unordered_map<std::string, uint64_t> internalLabels;
+    // rightOf[L] == R or leftOf[R] == L if [L, R] is a cluster,
+    // NO_INDEX for rows that are unused.
+    std::vector<NodeIndex> rightOf;
+    std::vector<NodeIndex> leftOf;
+
+    // Taxon id -> code, NO_INDEX for taxa that aren't in g.
+    std::vector<NodeIndex> internalLabels;
     size_t size;
 };
@@ -2,251 +2,281 @@
 
 #include <algorithm>
 #include <cstdint>
-#include <functional>
-#include <iterator>
-#include <unordered_map>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
-// Post order sequence with weights (PSW)
-static PSW genPSWHelper(
-    const Graph &g,
-    const std::vector<std::vector<uint64_t>> &adjList
-) {
-    PSW res;
-
-    std::function<uint64_t(uint64_t)> postOrder = [&](uint64_t node) -> uint64_t {
-        uint64_t weight = 0;
+static bool followAll(NodeIndex, NodeIndex) {
+    return true;
+}
 
-        auto leafIt = g.leafName.find(node);
+// Appends the post order sequence with weights of a subtree
+// without reticulations, pruning and suppressing nodes like emit.
+// start and length are scratch space, one entry per node.
+static void emitTree(
+    const Graph &g, NodeIndex root, PSW &psw,
+    std::vector<NodeIndex> &start, std::vector<NodeIndex> &length
+) {
+    auto enter = [&](NodeIndex node, NodeIndex, size_t) {
+        start[node] = psw.size();
+        return true;
+    };
 
-        if (leafIt == g.leafName.end()) {
-            uint64_t childrenWeight = 0;
+    auto leave = [&](NodeIndex node, NodeIndex) {
+        NodeIndex weight = psw.size() - start[node];
+        NodeIndex liveChildren = 0;
 
-            for (const uint64_t &c : adjList[node]) {
-                childrenWeight += postOrder(c);
+        for (const NodeIndex &c : g.children(node)) {
+            if (length[c] != 0) {
+                liveChildren++;
             }
+        }
 
-            weight += childrenWeight;
+        if (g.isLeaf(node)) {
+            psw.push_back(std::make_pair(node, 0));
+        } else if (liveChildren >= 2) {
+            psw.push_back(std::make_pair(node, weight));
         }
 
-        res.push_back(std::make_pair(node, weight));
-        return weight + 1;
+        length[node] = psw.size() - start[node];
     };
 
-    postOrder(g.root);
-
-    return res;
+    g.walk(root, followAll, enter, leave);
 }
 
-// Select an edge to use for a reticulation,
-// as in, 2 edges go into a node (reticulation),
-// and only want to consider one of the edges, not both.
-// Also removes unnecessary nodes after choosing an edge,
-// for example, A->B->C->D becomes A->D.
-static void pruneGraph(
-    std::vector<std::vector<uint64_t>> &adjList,
-    const std::unordered_map<uint64_t, std::unordered_set<uint64_t>> &parents,
-    const std::unordered_map<uint64_t, std::vector<uint64_t>::const_iterator> &curEdges
-) {
-    // Delete the edge between the reticulation and one of its parents
-    for (const auto &p : curEdges) {
-        uint64_t curParent = *p.second;
+InvariantBlocks::InvariantBlocks(const Graph &g) {
+    NodeIndex numNodes = g.getNumNodes();
 
-        auto it = std::find(adjList[curParent].begin(), adjList[curParent].end(), p.first);
-        adjList[curParent].erase(it);
-    }
-
-    std::unordered_set<uint64_t> completed;
+    // Whether there's no reticulation at or below each node.
+    std::vector<char> isFree(numNodes, false);
 
-    // Fix/reduce the node that the reticulations 
-    // disconnected from.
-    for (const auto &p : curEdges) {
-        uint64_t curNode = *p.second;
+    for (const NodeIndex &n : g.postorder()) {
+        bool res = !g.isReticulation(n);
 
-        if (completed.find(curNode) != completed.end()) {
-            // If 2 or more reticulations removed their edge
-            // from the same node.
-            continue;
+        for (const NodeIndex &c : g.children(n)) {
+            if (!isFree[c]) {
+                res = false;
+            }
         }
 
-        uint64_t targetNode;
-        bool foundTargetNode = false;
-
-        while (!foundTargetNode) {
-            size_t s = adjList[curNode].size();
-
-            if (s == 1) {
-                do {
-                    curNode = adjList[curNode][0];
-                } while (adjList[curNode].size() == 1);
-
-                targetNode = curNode;
-                foundTargetNode = true;
-            } else if (s == 0) {
-                std::unordered_set<uint64_t> parent = parents.at(curNode);
-
-                if (parent.size() == 2) {
-                    uint64_t ignoreNode = *curEdges.at(curNode);
-
-                    for (const uint64_t &e : parent) {
-                        if (e != ignoreNode) {
-                            curNode = e;
-                            break;
-                        }
-                    }
-                } else {
-                    curNode = *parent.begin();
-                }
+        isFree[n] = res;
 
-                auto it = std::find(adjList[curNode].begin(), adjList[curNode].end(), *p.second);
-                adjList[curNode].erase(it);
-            } else {
-                break;
+        // A child is the root of a block if it's free and the node isn't.
+        if (!res) {
+            for (const NodeIndex &c : g.children(n)) {
+                if (isFree[c] && !g.isLeaf(c)) {
+                    roots.push_back(c);
+                }
             }
         }
+    }
 
-        if (!foundTargetNode) {
-            continue;
-        }
+    blockOf.assign(numNodes, NO_BLOCK);
+    psws.resize(roots.size());
 
-        // Reduce the edge/node: A->B->C->D becomes A->D
-        uint64_t prevNode;
+    std::vector<NodeIndex> start(numNodes);
+    std::vector<NodeIndex> length(numNodes);
 
-        do {
-            prevNode = curNode;
-            std::unordered_set<uint64_t> parent = parents.at(curNode);
+    for (NodeIndex b = 0; b < roots.size(); b++) {
+        blockOf[roots[b]] = b;
+        emitTree(g, roots[b], psws[b], start, length);
+    }
+}
 
-            if (parent.size() == 2) {
-                uint64_t ignoreNode = *curEdges.at(curNode);
+NodeIndex InvariantBlocks::getBlock(NodeIndex node) const {
+    return blockOf[node];
+}
 
-                for (const uint64_t &e : parent) {
-                    if (e != ignoreNode) {
-                        curNode = e;
-                        break;
-                    }
-                }
-            } else {
-                curNode = *parent.begin();
-            }
-            /* if (parents.at(curNode).size() >= 3) {
-                continue;
-            } */
+DisplayTreeEnumerator::DisplayTreeEnumerator(const Graph &g, const InvariantBlocks *blocks)
+: g(g), blocks(blocks) {
+    NodeIndex numNodes = g.getNumNodes();
+
+    activeParent.resize(numNodes);
+    segLength.resize(numNodes);
+    segOffset.resize(numNodes);
+    cursor.resize(numNodes);
+    live.resize(numNodes);
+    dirtyStep.resize(numNodes);
 
-        } while (adjList[curNode].size() == 1);
+    cur.reserve(numNodes);
+    prev.reserve(numNodes);
 
-        auto it = std::find(adjList[curNode].begin(), adjList[curNode].end(), prevNode);
-        *it = targetNode;
+    switching = g.reticulationNodes;
+
+    reset();
+}
 
-        completed.insert(*p.second);
+void DisplayTreeEnumerator::restrictTo(const std::vector<NodeIndex> &reticulations) {
+    switching = reticulations;
+    reset();
+}
+
+void DisplayTreeEnumerator::reset() {
+    for (NodeIndex n = 0; n < g.getNumNodes(); n++) {
+        NodeSpan parents = g.parents(n);
+        activeParent[n] = parents.empty() ? NO_NODE : parents[0];
     }
 
-    // Fix/reduce the reticulations themselves if need be
-    for (const auto &p : curEdges) {
-        if (completed.find(p.first) != completed.end()) {
-            continue;
-        }
+    choice.assign(switching.size(), 0);
+    direction.assign(switching.size(), 1);
+
+    std::fill(dirtyStep.begin(), dirtyStep.end(), 0);
+    step = 0;
+    moved = NO_NODE;
+    movedFrom = NO_NODE;
 
-        uint64_t targetNode = p.first;
+    cur.clear();
+    rebuildAll = true;
+    emit(g.root);
+    rebuildAll = false;
+}
 
-        while (adjList[targetNode].size() == 1) {
-            targetNode = adjList[targetNode][0];
+bool DisplayTreeEnumerator::next() {
+    // Reflected mixed-radix Gray code: move the lowest digit that can
+    // still move in its current direction, and turn around the ones below it.
+    size_t k = 0;
 
-            if (curEdges.find(targetNode) != curEdges.end()) {
-                completed.insert(targetNode);
-            }
+    for (; k < choice.size(); k++) {
+        size_t numParents = g.parents(switching[k]).size();
+        size_t c = choice[k] + direction[k];
+
+        if (c < numParents) {
+            choice[k] = c;
+            break;
         }
 
-        uint64_t curNode = p.first;
-        uint64_t prevNode;
+        direction[k] = -direction[k];
+    }
 
-        do {
-            prevNode = curNode;
-            std::unordered_set<uint64_t> parent = parents.at(curNode);
+    if (k == choice.size()) {
+        return false;
+    }
 
-            if (parent.size() == 2) {
-                uint64_t ignoreNode = *curEdges.at(curNode);
-                completed.insert(curNode);
+    moved = switching[k];
+    movedFrom = activeParent[moved];
+    activeParent[moved] = g.parents(moved)[choice[k]];
 
-                for (const uint64_t &e : parent) {
-                    if (e != ignoreNode) {
-                        curNode = e;
-                        break;
-                    }
-                }
-            } else {
-                curNode = *parent.begin();
-            }
-            /* if (parents.at(curNode).size() >= 3) {
-                continue;
-            } */
-        } while (adjList[curNode].size() == 1);
+    // Only the nodes on the paths from both parents
+    // up to the root can have a different segment.
+    step++;
+    markDirty(movedFrom);
+    markDirty(activeParent[moved]);
 
-        auto it = std::find(adjList[curNode].begin(), adjList[curNode].end(), prevNode);
-        *it = targetNode;
+    segOffset[g.root] = 0;
+    locate(g.root);
 
-        completed.insert(p.first);
-    }
+    std::swap(cur, prev);
+    cur.clear();
+    emit(g.root);
+
+    return true;
 }
 
-static std::unordered_map<uint64_t, std::unordered_set<uint64_t>> getParents(
-    const Graph &g
-) {
-    std::unordered_map<uint64_t, std::unordered_set<uint64_t>> res;
-    res.reserve(g.adjList.size());
+const PSW &DisplayTreeEnumerator::psw() const {
+    return cur;
+}
 
-    std::function<void(uint64_t)> postOrder = [&](uint64_t curParent) -> void {
-        for (const uint64_t &c : g.adjList[curParent]) {
-            res[c].insert(curParent);
-            postOrder(c);
-        }
-    };
+uint64_t DisplayTreeEnumerator::getNumTrees() const {
+    uint64_t res = 1;
 
-    postOrder(g.root);
+    for (const NodeIndex &r : switching) {
+        res *= g.parents(r).size();
+    }
 
     return res;
 }
 
-std::vector<PSW> genPSWs(
-    const Graph &g
-) {
-    std::vector<std::vector<uint64_t>> copy = g.adjList;
-    std::vector<PSW> psw;
-
-    std::unordered_map<uint64_t, std::vector<uint64_t>::const_iterator> curEdges;
-    curEdges.reserve(g.reticulations.size());
+bool DisplayTreeEnumerator::isDirty(NodeIndex node) const {
+    return rebuildAll || dirtyStep[node] == step;
+}
 
-    for (const auto &p : g.reticulations) {
-        curEdges[p.first] = p.second.begin();
+void DisplayTreeEnumerator::markDirty(NodeIndex node) {
+    while (node != NO_NODE && dirtyStep[node] != step) {
+        dirtyStep[node] = step;
+        node = activeParent[node];
     }
+}
 
-    std::vector<uint64_t>::iterator it;
+// Finds where the children of the dirty nodes start in the previous PSW.
+// A node's segment is its children's segments back to back,
+// followed by the node itself unless it was pruned or suppressed.
+void DisplayTreeEnumerator::locate(NodeIndex root) {
+    auto wasActive = [&](NodeIndex node, NodeIndex c) {
+        return c == moved ? node == movedFrom : activeParent[c] == node;
+    };
 
-    std::unordered_map<uint64_t, std::unordered_set<uint64_t>> parents = getParents(g);
+    // cursor[n] is where the next child of n starts.
+    auto enter = [&](NodeIndex node, NodeIndex parent, size_t) {
+        if (parent != NO_NODE) {
+            segOffset[node] = cursor[parent];
+            cursor[parent] += segLength[node];
+        }
+
+        cursor[node] = segOffset[node];
+
+        return isDirty(node);
+    };
+
+    g.walk(root, wasActive, enter, [](NodeIndex, NodeIndex) {}, stack);
+}
+
+// Appends the post order sequence with weights of the node's subtree.
+// Nodes left without any leaf below them are pruned, and nodes left with
+// a single child are suppressed, for example, A->B->C->D becomes A->D.
+void DisplayTreeEnumerator::emit(NodeIndex root) {
+    auto isActive = [&](NodeIndex node, NodeIndex c) {
+        return activeParent[c] == node;
+    };
 
-    while (true) {
-        pruneGraph(copy, parents, curEdges);
+    // cursor[n] is where n's segment starts in cur, and live[n] how many
+    // of its children have something left in theirs. The root is always
+    // dirty, so only nodes with a parent get past the first two checks.
+    auto enter = [&](NodeIndex node, NodeIndex parent, size_t) {
+        if (!isDirty(node)) {
+            auto first = prev.begin() + segOffset[node];
+            cur.insert(cur.end(), first, first + segLength[node]);
+            live[parent] += segLength[node] != 0;
 
-        psw.emplace_back(genPSWHelper(g, copy));
+            return false;
+        }
 
-        auto it = curEdges.begin();
-        while (it != curEdges.end()) {
-            if (std::next(it->second) != g.reticulations.at(it->first).end()) {
-                it->second++;
-                break;
+        // Blocks have no reticulation below them, so they're never dirty
+        // and this only happens while rebuilding everything.
+        if (blocks != nullptr && blocks->getBlock(node) != NO_BLOCK) {
+            if (blocks->psws[blocks->getBlock(node)].empty()) {
+                segLength[node] = 0;
             } else {
-                it->second = g.reticulations.at(it->first).begin();
+                cur.push_back(std::make_pair(node, 0));
+                segLength[node] = 1;
+                live[parent]++;
             }
 
-            it++;
+            return false;
         }
 
-        if (it == curEdges.end()) {
-            break;
+        cursor[node] = cur.size();
+        live[node] = 0;
+
+        return true;
+    };
+
+    auto leave = [&](NodeIndex node, NodeIndex parent) {
+        NodeIndex weight = cur.size() - cursor[node];
+        NodeIndex liveChildren = live[node];
+
+        if (g.isLeaf(node)) {
+            cur.push_back(std::make_pair(node, 0));
+            segLength[node] = 1;
+        } else if (liveChildren >= 2) {
+            cur.push_back(std::make_pair(node, weight));
+            segLength[node] = weight + 1;
+        } else {
+            segLength[node] = weight;
         }
 
-        std::copy(g.adjList.begin(), g.adjList.end(), copy.begin());
-    }
+        if (parent != NO_NODE) {
+            live[parent] += segLength[node] != 0;
+        }
+    };
 
-    return psw;
+    g.walk(root, isActive, enter, leave, stack);
 }
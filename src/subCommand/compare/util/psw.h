@@ -1,7 +1,100 @@
 #pragma once
 
+#include <cstdint>
+#include <utility>
+#include <vector>
+
 #include "../../../graph.h"
 
-using PSW = std::vector<std::pair<uint64_t, uint64_t>>;
+using PSW = std::vector<std::pair<NodeIndex, NodeIndex>>;
+
+// getBlock value of a node that isn't the root of a block.
+const NodeIndex NO_BLOCK = NO_INDEX;
+
+// The largest subtrees of a network without any reticulation in them,
+// leaving out leaves and the whole network. They're the same in every
+// display tree, so their clusters only need to be found once.
+struct InvariantBlocks {
+public:
+    InvariantBlocks(const Graph &g);
+
+    NodeIndex getBlock(NodeIndex node) const;
+
+public:
+    // roots[b] is the root node of block b and psws[b] its post order
+    // sequence with weights, which is empty if there's no leaf under it.
+    std::vector<NodeIndex> roots;
+    std::vector<PSW> psws;
+
+    std::vector<NodeIndex> blockOf;
+};
+
+// Enumerates the display trees of a network in Gray-code order,
+// so going from one tree to the next switches exactly one reticulation
+// to another of its parents. Only the nodes above the old and new parent
+// are rebuilt, every other subtree is copied from the previous PSW.
+// If given blocks, each block is emitted as a single pseudo leaf
+// (root of the block, 0), so a PSW only has the part of the display
+// tree that can change.
+struct DisplayTreeEnumerator {
+public:
+    DisplayTreeEnumerator(const Graph &g, const InvariantBlocks *blocks = nullptr);
+
+    // Only lets the given reticulations switch parents, every other one
+    // stays with its first parent. Goes back to the first display tree.
+    void restrictTo(const std::vector<NodeIndex> &reticulations);
+
+    // Goes back to the first display tree.
+    void reset();
+
+    // Moves on to the next display tree.
+    // Returns false once every display tree has been visited.
+    bool next();
+
+    // Only valid until the next call to next() or reset().
+    const PSW &psw() const;
+
+    uint64_t getNumTrees() const;
+
+private:
+    bool isDirty(NodeIndex node) const;
+    void markDirty(NodeIndex node);
+
+    void locate(NodeIndex node);
+    void emit(NodeIndex node);
+
+private:
+    const Graph &g;
+    const InvariantBlocks *blocks;
+
+    // The parent whose edge into a node is part of the current tree.
+    std::vector<NodeIndex> activeParent;
+
+    // The reticulations that switch parents, all of them by default.
+    std::vector<NodeIndex> switching;
+
+    // Gray-code digit of each switching reticulation: the index of the parent
+    // it currently uses, and which way that index is moving.
+    std::vector<size_t> choice;
+    std::vector<int> direction;
+
+    // Length of each node's segment in the current PSW (0 if pruned)
+    // and, while stepping, where that segment starts.
+    std::vector<NodeIndex> segLength;
+    std::vector<NodeIndex> segOffset;
+    // Scratch space for locate and emit.
+    std::vector<NodeIndex> cursor;
+    std::vector<NodeIndex> live;
+    WalkStack stack;
+
+    std::vector<uint64_t> dirtyStep;
+    uint64_t step;
+    bool rebuildAll;
+
+    // The reticulation that switched parents in the last step.
+    NodeIndex moved;
+    NodeIndex movedFrom;
 
-std::vector<PSW> genPSWs(const Graph &g);
+    PSW cur;
+    PSW prev;
+};
@@ -0,0 +1,44 @@
+#include "taxa.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+TaxonDictionary taxa;
+
+NodeIndex TaxonDictionary::add(const std::string &name) {
+    auto it = ids.emplace(name, names.size());
+
+    if (it.second) {
+        names.push_back(name);
+    }
+
+    return it.first->second;
+}
+
+NodeIndex TaxonDictionary::getId(const std::string &name) {
+    std::lock_guard<std::mutex> guard(lock);
+    return add(name);
+}
+
+void TaxonDictionary::getIds(const std::vector<std::string> &leafNames, std::vector<NodeIndex> &res) {
+    std::lock_guard<std::mutex> guard(lock);
+
+    res.clear();
+    res.reserve(leafNames.size());
+
+    for (const std::string &n : leafNames) {
+        res.push_back(add(n));
+    }
+}
+
+const std::string &TaxonDictionary::getName(NodeIndex id) const {
+    std::lock_guard<std::mutex> guard(lock);
+    return names[id];
+}
+
+size_t TaxonDictionary::size() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return names.size();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nodeIndex.h"
+
+// Gives every leaf name seen during a run a dense id. It's shared by
+// every graph, so the same name gets the same id in all of them.
+// Graphs can be loaded on one thread while others compare, so every
+// call takes a lock.
+struct TaxonDictionary {
+public:
+    // Returns the id of the name, adding it if it hasn't been seen yet.
+    NodeIndex getId(const std::string &name);
+    // Same as getId for every name, under a single lock.
+    void getIds(const std::vector<std::string> &leafNames, std::vector<NodeIndex> &res);
+    const std::string &getName(NodeIndex id) const;
+
+    size_t size() const;
+
+private:
+    NodeIndex add(const std::string &name);
+
+private:
+    std::unordered_map<std::string, NodeIndex> ids;
+    // A deque so getName's references survive later additions.
+    std::deque<std::string> names;
+    mutable std::mutex lock;
+};
+
+extern TaxonDictionary taxa;
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Runs PhyloGraphUtil on the sample networks and compares what it prints
+# with tests/expected/<name>.out. Run from the repository root, after make.
+
+BIN="$(pwd)/bin/PhyloGraphUtil"
+TESTS="$(pwd)/tests"
+TMP="$(mktemp -d)"
+trap 'rm -rf "$TMP"' EXIT
+
+# Some commands print the names of their inputs, so they're given copies
+# in the scratch directory instead of paths that depend on the checkout.
+cp "$TESTS"/*.enwk "$TESTS"/*.gml "$TMP"
+
+failed=0
+
+# check <name> <command...>: runs the command in a scratch directory.
+# A command that fails has its exit status added to what it printed.
+check() {
+    name="$1"
+    shift
+
+    (cd "$TMP" && "$@") > "$TMP/$name.out" 2>&1 || echo "exit $?" >> "$TMP/$name.out"
+
+    if cmp -s "$TMP/$name.out" "$TESTS/expected/$name.out"; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        diff "$TESTS/expected/$name.out" "$TMP/$name.out"
+        failed=1
+    fi
+}
+
+# Precision and recall don't depend on the order display trees are
+# enumerated in, and F1 is 0 rather than NaN when both are 0.
+check pr-5L1R "$BIN" compare pr "$TESTS/C-5L1R.enwk" "$TESTS/D-5L1R.enwk"
+check pr-simple "$BIN" compare pr "$TESTS/simpleA.enwk" "$TESTS/simpleB.enwk"
+
+# Edge weights and admixture proportions survive a trip through a snapshot.
+check admix-snap sh -c "\"$BIN\" convert \"$TESTS/test.admix\" SNAP rt && \"$BIN\" convert rt.pgsnap ADMIX rt && cat rt.admix"
+
+# Comparing through the cluster index (-i) gives the same answer as
+# comparing every pair of display trees, and both refuse repeated names.
+check rf-5L1R "$BIN" compare rf A-5L1R.enwk B-5L1R.enwk
+check rf-5L1R-index "$BIN" compare -i rf A-5L1R.enwk B-5L1R.enwk
+check rf-3L0R "$BIN" compare rf A-3L0R.gml B-3L0R.gml
+check rf-3L0R-index "$BIN" compare -i rf A-3L0R.gml B-3L0R.gml
+
+# Two networks without a non-trivial cluster are 0% different, not NaN.
+check ji-2L0R "$BIN" compare ji A-2L0R.enwk A-2L0R.enwk
+
+exit $failed